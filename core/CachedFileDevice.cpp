@@ -1,5 +1,9 @@
 #include "CachedFileDevice.h"
 #include <QDebug>
+#include <QScopeGuard>
+#include <QThreadPool>
+
+constexpr qint64 READ_SKIP_SIZE = 512 * 1024;
 
 CachedFileDevice::CachedFileDevice(QIODevice *source, qint64 chunkSize, QObject *parent)
     : QIODevice(parent)
@@ -46,11 +50,22 @@ bool CachedFileDevice::open(OpenMode mode)
         return false;
     }
 
-    return QIODevice::open(mode);
+    if (!QIODevice::open(mode))
+        return false;
+
+    if (m_pendingPrefetchFactory) {
+        startPrefetch(m_pendingPrefetchPos, std::move(m_pendingPrefetchFactory));
+        m_pendingPrefetchFactory = nullptr;
+    }
+
+    return true;
 }
 
 void CachedFileDevice::close()
 {
+    // prefetcher writes into the mapped cache, stop it before unmapping
+    stopPrefetch();
+
     m_cacheFile.close();
     m_cachedChunks.clear();
     m_pos = 0;
@@ -114,44 +129,132 @@ qint64 CachedFileDevice::writeData(const char *data, qint64 len)
 
 bool CachedFileDevice::ensureCacheAvailable(qint64 pos, qint64 len)
 {
-    const qint64 totalSize = size();
     const qint64 startChunk = pos / m_chunkSize;
     const qint64 endChunk = (pos + len - 1) / m_chunkSize;
 
     for (qint64 i = startChunk; i <= endChunk; ++i) {
-        if (!m_cachedChunks[i]) {
-            qint64 chunkStart = i * m_chunkSize;
+        {
+            QMutexLocker locker(&m_mutex);
 
-            // Handle the potential partial chunk at the very end of the file
-            qint64 bytesToRead = qMin(m_chunkSize, totalSize - chunkStart);
+            // region is being filled by the prefetcher, wait for it instead of
+            // moving the source away from where the player is reading
+            while (!m_cachedChunks[i] && m_prefetchRunning && i >= m_prefetchStartChunk)
+                m_chunkCached.wait(&m_mutex);
 
-            if (bytesToRead <= 0)
-                break;
+            if (m_cachedChunks[i])
+                continue;
+        }
 
-            // Sync source position
-            if (m_source->pos() != chunkStart) {
-                if (!m_source->seek(chunkStart))
-                    return false;
-            }
+        if (!fetchChunk(m_source, i))
+            return false;
+    }
 
-            QByteArray buffer(bytesToRead, Qt::Uninitialized);
-            qint64 bytesRead = 0;
+    return true;
+}
 
-            // Pull data into buffer
-            while (bytesToRead != bytesRead) {
-                const auto currentRead = m_source->read(buffer.data() + bytesRead,
-                                                        (bytesToRead - bytesRead));
-                if (currentRead == -1)
-                    return false;
+bool CachedFileDevice::fetchChunk(QIODevice *source, qint64 chunk)
+{
+    const qint64 chunkStart = chunk * m_chunkSize;
 
-                bytesRead += currentRead;
-            }
+    // Handle the potential partial chunk at the very end of the file
+    const qint64 bytesToRead = qMin(m_chunkSize, size() - chunkStart);
+    if (bytesToRead <= 0)
+        return true;
 
-            // Write buffer to the temporary cache file
-            std::memcpy(m_cachePtr + chunkStart, buffer.constData(), bytesRead);
-            m_cachedChunks[i] = true;
-        }
+    // Sync source position
+    if (source->pos() != chunkStart) {
+        if (!source->seek(chunkStart))
+            return false;
+    }
+
+    // Pull data directly into the mapped cache, chunks never overlap so
+    // concurrent fetches of different chunks don't need the lock here
+    char *dest = reinterpret_cast<char *>(m_cachePtr + chunkStart);
+    qint64 bytesRead = 0;
+    while (bytesToRead != bytesRead) {
+        const auto currentRead = source->read(dest + bytesRead, (bytesToRead - bytesRead));
+        if (currentRead <= 0)
+            return false;
+
+        bytesRead += currentRead;
     }
 
+    QMutexLocker locker(&m_mutex);
+    m_cachedChunks[chunk] = true;
+    m_chunkCached.notify_all();
     return true;
 }
+
+void CachedFileDevice::prefetch(qint64 pos, SourceFactory factory)
+{
+    if (!isOpen()) {
+        m_pendingPrefetchPos = pos;
+        m_pendingPrefetchFactory = std::move(factory);
+        return;
+    }
+
+    startPrefetch(pos, std::move(factory));
+}
+
+void CachedFileDevice::startPrefetch(qint64 pos, SourceFactory factory)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_prefetchRunning || pos < 0 || pos >= size())
+        return;
+
+    m_prefetchRunning = true;
+    m_prefetchAborted = false;
+    m_prefetchStartChunk = pos / m_chunkSize;
+
+    QThreadPool::globalInstance()->start([this, factory = std::move(factory)]() {
+        runPrefetch(factory);
+    });
+}
+
+void CachedFileDevice::runPrefetch(const SourceFactory &factory)
+{
+    auto cleanup = qScopeGuard([this] {
+        QMutexLocker locker(&m_mutex);
+        m_prefetchRunning = false;
+        m_chunkCached.notify_all();
+        m_prefetchStopped.notify_all();
+    });
+
+    std::unique_ptr<QIODevice> source = factory();
+    if (!source || !source->open(QIODevice::ReadOnly)) {
+        qWarning("failed to open prefetch source");
+        return;
+    }
+
+    const qint64 startPos = m_prefetchStartChunk * m_chunkSize;
+    if (!source->seek(startPos)) {
+        // source can't seek, do a parallel pass till the start position
+        QByteArray skipBuffer(READ_SKIP_SIZE, Qt::Uninitialized);
+        qint64 toSkip = startPos - source->pos();
+        while (toSkip > 0 && !m_prefetchAborted) {
+            const qint64 bytesRead = source->read(skipBuffer.data(),
+                                                  qMin<qint64>(toSkip, skipBuffer.size()));
+            if (bytesRead <= 0)
+                return;
+
+            toSkip -= bytesRead;
+        }
+    }
+
+    const qint64 chunkCount = m_cachedChunks.size();
+    for (qint64 i = m_prefetchStartChunk; i < chunkCount && !m_prefetchAborted; ++i) {
+        if (!fetchChunk(source.get(), i)) {
+            qWarning("prefetch failed at chunk %lld", i);
+            return;
+        }
+    }
+}
+
+void CachedFileDevice::stopPrefetch()
+{
+    m_prefetchAborted = true;
+
+    QMutexLocker locker(&m_mutex);
+    while (m_prefetchRunning)
+        m_prefetchStopped.wait(&m_mutex);
+}
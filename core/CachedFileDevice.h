@@ -2,8 +2,13 @@
 #define CACHEDFILEDEVICE_H
 
 #include <QIODevice>
+#include <QMutex>
 #include <QSet>
 #include <QTemporaryFile>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 class CachedFileDevice : public QIODevice
 {
@@ -27,12 +32,26 @@ public:
     bool seek(qint64 pos) override;
     bool atEnd() const override;
 
+    using SourceFactory = std::function<std::unique_ptr<QIODevice>()>;
+
+    /**
+     * Fill the cache from @p pos till the end of file in background, using a second
+     * device created by @p factory, reads of that region wait for the prefetcher instead
+     * of repositioning the main source. If the device isn't open yet, prefetch
+     * starts with open().
+     */
+    void prefetch(qint64 pos, SourceFactory factory);
+
 protected:
     qint64 readData(char *data, qint64 maxlen) override;
     qint64 writeData(const char *data, qint64 len) override;
 
 private:
     bool ensureCacheAvailable(qint64 pos, qint64 len);
+    bool fetchChunk(QIODevice *source, qint64 chunk);
+    void startPrefetch(qint64 pos, SourceFactory factory);
+    void runPrefetch(const SourceFactory &factory);
+    void stopPrefetch();
 
     QIODevice *m_source;
     QTemporaryFile m_cacheFile;
@@ -40,6 +59,18 @@ private:
     qint64 m_pos;
     std::vector<bool> m_cachedChunks;
     uchar *m_cachePtr = nullptr; // Pointer to the mapped memory
+
+    // guards m_cachedChunks and prefetch state
+    QMutex m_mutex;
+    QWaitCondition m_chunkCached;
+    QWaitCondition m_prefetchStopped;
+    bool m_prefetchRunning = false;
+    qint64 m_prefetchStartChunk = -1;
+    std::atomic<bool> m_prefetchAborted{false};
+
+    // prefetch requested before open()
+    qint64 m_pendingPrefetchPos = -1;
+    SourceFactory m_pendingPrefetchFactory;
 };
 
 #endif // CACHEDFILEDEVICE_H
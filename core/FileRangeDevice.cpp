@@ -0,0 +1,58 @@
+#include "FileRangeDevice.h"
+
+FileRangeDevice::FileRangeDevice(const QString &filePath,
+                                 qint64 offset,
+                                 qint64 size,
+                                 QObject *parent)
+    : QIODevice(parent)
+    , m_file(filePath)
+    , m_offset(offset)
+    , m_size(size)
+{}
+
+bool FileRangeDevice::open(OpenMode mode)
+{
+    if (mode != QIODevice::ReadOnly) {
+        setErrorString("Only ReadOnly mode is supported.");
+        return false;
+    }
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        setErrorString(m_file.errorString());
+        return false;
+    }
+
+    if (m_offset < 0 || m_offset + m_size > m_file.size()) {
+        setErrorString("Range is outside of the file.");
+        m_file.close();
+        return false;
+    }
+
+    // unbuffered so that pos() in readData() is always the position to read from
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void FileRangeDevice::close()
+{
+    m_file.close();
+    QIODevice::close();
+}
+
+qint64 FileRangeDevice::readData(char *data, qint64 maxlen)
+{
+    const qint64 len = qMin(maxlen, m_size - pos());
+    if (len <= 0)
+        return 0; // EOF reached
+
+    if (!m_file.seek(m_offset + pos()))
+        return -1;
+
+    return m_file.read(data, len);
+}
+
+qint64 FileRangeDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
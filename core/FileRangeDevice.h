@@ -0,0 +1,34 @@
+#ifndef FILERANGEDEVICE_H
+#define FILERANGEDEVICE_H
+
+#include <QFile>
+#include <QIODevice>
+
+/**
+ * Read only view over [offset, offset + size) of a file, used for entries
+ * which are stored uncompressed inside an archive.
+ */
+class FileRangeDevice : public QIODevice
+{
+public:
+    FileRangeDevice(const QString &filePath,
+                    qint64 offset,
+                    qint64 size,
+                    QObject *parent = nullptr);
+
+    bool isSequential() const override { return false; }
+    bool open(OpenMode mode) override;
+    void close() override;
+    qint64 size() const override { return m_size; }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    QFile m_file;
+    const qint64 m_offset;
+    const qint64 m_size;
+};
+
+#endif // FILERANGEDEVICE_H
@@ -8,17 +8,49 @@
 #include <QTemporaryFile>
 
 #include "CachedFileDevice.h"
+#include "FileRangeDevice.h"
 #include "asyncarchiveiodevice.h"
+#include "incrementalnotifier.hpp"
+#include <QReadWriteLock>
+#include <QThreadPool>
 #include <archive.h>
 #include <archive_entry.h>
 #include <qelapsedtimer.h>
 #include <qrunnable.h>
+#include <future>
 
 namespace
 {
 
 class ArchiveDir;
 
+/*
+ * what the archive allows us to do when reading entries, probed once while
+ * building the tree and used to pick a reader for each entry
+ */
+struct ArchiveCapabilities
+{
+    int format = 0;
+    QString formatName;
+
+    // compression filters wrapping the archive (gzip, xz, ..), outermost last
+    QVector<int> filters;
+
+    // archive_seek_data() works for entries
+    bool seekable = false;
+
+    // entries are compressed together in blocks, can't be decoded independently
+    bool solid = false;
+};
+
+// a tree which is still being built in background, nodes may only be read with
+// the lock held till the build is complete
+struct TreeBuild
+{
+    QReadWriteLock lock;
+    IncrementalNotifier notifier;
+};
+
 static const QString CHILD_KEY = "child";
 static const QString URL_SCHEME = "archivesystem";
 
@@ -196,6 +228,10 @@ class ArchiveFile : public ArchiveNode
 public:
     using ArchiveNode::ArchiveNode;
 
+    // entry is stored uncompressed at dataOffset_ of the archive file
+    bool stored_ = false;
+    qint64 dataOffset_ = -1;
+
     QDateTime lastAccessTime_;
     QDateTime creationTime_;
     QDateTime modifiedTime_;
@@ -225,6 +261,10 @@ public:
     QVector<ArchiveNode *> children;
     std::shared_ptr<QTemporaryFile> source;
 
+    // only valid for root
+    ArchiveCapabilities caps;
+    std::shared_ptr<TreeBuild> build;
+
     using ArchiveNode::ArchiveNode;
 
     ~ArchiveDir()
@@ -255,13 +295,35 @@ public:
     {
         return children[i]->modifiedTime();
     }
+
+    void fill(int first, int count, DirectoryColumns::Fields fields, DirectoryColumns &columns) override
+    {
+        for (int i = first; i < first + count; ++i)
+        {
+            const auto child = children[i];
+            if (fields & DirectoryColumns::Names)
+                columns.names.push_back(child->name_);
+            if (fields & DirectoryColumns::Paths)
+                columns.paths.push_back(child->path());
+            if (fields & DirectoryColumns::Sizes)
+                columns.sizes.push_back(child->size_);
+            if (fields & DirectoryColumns::Dirs)
+                columns.dirs.push_back(child->dir());
+            if (fields & DirectoryColumns::LastAccessTimes)
+                columns.lastAccessTimes.push_back(DirectoryColumns::toMSecs(child->lastAccessTime()));
+            if (fields & DirectoryColumns::CreationTimes)
+                columns.creationTimes.push_back(DirectoryColumns::toMSecs(child->creationTime()));
+            if (fields & DirectoryColumns::ModifiedTimes)
+                columns.modifiedTimes.push_back(DirectoryColumns::toMSecs(child->modifiedTime()));
+        }
+    }
 };
 
 /*
  * Used to keep a reference true reference to root when returing child directory
  * the root owns all children (including nth-grand children)
 */
-class SharedDirectory : public Directory
+class SharedDirectory : public Directory, public IncrementalDirectory
 {
 public:
     // reference to root
@@ -272,7 +334,25 @@ public:
 
     SharedDirectory(std::shared_ptr<ArchiveDir> r, ArchiveDir *d) : r {r}, d {d} {}
 
-#define SHAREDDIRECTORY_WRAP(type, name) type name () override { return d->name (); }
+    ~SharedDirectory()
+    {
+        setProgressCallback(nullptr);
+    }
+
+    // null when tree is already complete, QReadLocker ignores null locks
+    QReadWriteLock *treeLock() const { return r->build ? &r->build->lock : nullptr; }
+
+    DirectoryType type() const override { return DirectoryType::Archive; }
+
+    bool isComplete() override { return !r->build || r->build->notifier.isComplete(); }
+
+    void setProgressCallback(ProgressCallback cb) override
+    {
+        if (r->build)
+            r->build->notifier.setCallback(this, std::move(cb));
+    }
+
+#define SHAREDDIRECTORY_WRAP(type, name) type name () override { QReadLocker l(treeLock()); return d->name (); }
 
     SHAREDDIRECTORY_WRAP(QString, path)
     SHAREDDIRECTORY_WRAP(QString, name)
@@ -281,7 +361,7 @@ public:
     SHAREDDIRECTORY_WRAP(int, fileCount)
 
 #undef SHAREDDIRECTORY_WRAP
-#define SHAREDDIRECTORY_WRAP(type, name) type name (int i) override { return d->name (i); }
+#define SHAREDDIRECTORY_WRAP(type, name) type name (int i) override { QReadLocker l(treeLock()); return d->name (i); }
 
     SHAREDDIRECTORY_WRAP(QString, fileName)
     SHAREDDIRECTORY_WRAP(QString, filePath)
@@ -294,6 +374,12 @@ public:
     SHAREDDIRECTORY_WRAP(QDateTime, fileModifiedTime)
 
 #undef SHAREDDIRECTORY_WRAP
+
+    void fill(int first, int count, DirectoryColumns::Fields fields, DirectoryColumns &columns) override
+    {
+        QReadLocker l(treeLock());
+        d->fill(first, count, fields, columns);
+    }
 };
 
 
@@ -316,7 +402,10 @@ QString pathName(const QString &filePath)
 }
 
 
-bool iterateArchiveEntries(const QString &archivepath, std::function<bool(archive * archive, archive_entry *entry)> functor)
+// @functor stops the iteration by returning true, returns false if archive can't be read or once @cancel is cancelled
+bool iterateArchiveEntries(const QString &archivepath
+                           , std::function<bool(archive * archive, archive_entry *entry)> functor
+                           , const CancellationToken &cancel = {})
 {
     std::unique_ptr<archive, decltype(&archive_read_free)> a (archive_read_new(), &archive_read_free);
     if (!a)
@@ -336,46 +425,119 @@ bool iterateArchiveEntries(const QString &archivepath, std::function<bool(archiv
     }
 
     archive_entry *entry {};
-    while (archive_read_next_header(a.get(), &entry) == ARCHIVE_OK)
+    while (!cancel.isCancelled() && archive_read_next_header(a.get(), &entry) == ARCHIVE_OK)
     {
         if (functor(a.get(), entry))
-            return true;
+            return !cancel.isCancelled();
 
         archive_read_data_skip(a.get());
     }
 
-    return true;
+    return !cancel.isCancelled();
 }
 
 
 
+ArchiveCapabilities probeCapabilities(archive *a)
+{
+    ArchiveCapabilities caps;
+    caps.format = archive_format(a);
+    caps.formatName = QString::fromUtf8(archive_format_name(a));
+
+    for (int i = 0; i < archive_filter_count(a); ++i) {
+        const int code = archive_filter_code(a, i);
+        if (code != ARCHIVE_FILTER_NONE)
+            caps.filters.push_back(code);
+    }
+
+    const int family = caps.format & ARCHIVE_FORMAT_BASE_MASK;
+
+    // 7z compresses entries in solid blocks
+    caps.solid = (family == ARCHIVE_FORMAT_7ZIP);
+
+    // libarchive supports archive_seek_data() only for rar v4, zip entries are
+    // either stored or decoded as a stream
+    caps.seekable = caps.filters.isEmpty()
+                    && !caps.solid
+                    && caps.format == ARCHIVE_FORMAT_RAR;
+
+    return caps;
+}
+
+// must be called right after reading the header of @entry
+bool isStoredEntry(archive *a, archive_entry *entry, const ArchiveCapabilities &caps)
+{
+    if (!caps.filters.isEmpty()
+        || archive_entry_is_encrypted(entry)
+        || archive_entry_sparse_count(entry) > 0)
+        return false;
+
+    switch (caps.format & ARCHIVE_FORMAT_BASE_MASK)
+    {
+    case ARCHIVE_FORMAT_TAR:
+        return true;
+    case ARCHIVE_FORMAT_ZIP:
+        // zip reader reports compression of current entry through format name
+        return QLatin1StringView(archive_format_name(a)).contains(QLatin1StringView("uncompressed"));
+    }
+
+    return false;
+}
+
 struct BuildTreeResult
 {
     std::unique_ptr<ArchiveDir> root;
     ArchiveNode *child {}; // owned by root
 };
 
-
-BuildTreeResult buildTree(const QString &filePath, const QString &childpath, const ArchiveUrl &baseUrl)
+QString rootName(const ArchiveUrl &baseUrl)
 {
-    const auto rootName = baseUrl.childrenCount() > 0
+    return baseUrl.childrenCount() > 0
             ? pathName(baseUrl.children().back())
             : pathName(baseUrl.archivePath());
+}
 
-    std::unique_ptr<ArchiveDir> root {new ArchiveDir(nullptr, rootName, baseUrl, 0)};
-    ArchiveNode *child {};
-
+/*
+ * adds entries of @filePath to @root, @child is set to the node at @childpath
+ *
+ * if root has a build, nodes are inserted with its lock held so that the tree can
+ * be read while it grows, @progress is called after each entry and stops the
+ * traversal by returning true
+ */
+bool fillTree(ArchiveDir *root
+              , const QString &filePath
+              , const QString &childpath
+              , const ArchiveUrl &baseUrl
+              , ArchiveNode **child
+              , const std::function<bool ()> &progress = {}
+              , const CancellationToken &cancel = {})
+{
     QHash<ArchiveDir *, QHash<QString, ArchiveDir *>> dirMap;
+    bool capsProbed = false;
+
+    const auto setChild = [&](const QString &nodepath, ArchiveNode *node)
+    {
+        if (child && !*child && (nodepath == childpath))
+            *child = node;
+    };
 
-    const auto insertFileNode = [&](archive *, archive_entry *entry)
+    const auto insertFileNode = [&](archive *a, archive_entry *entry)
     {
+        QWriteLocker l(root->build ? &root->build->lock : nullptr);
+
+        if (!capsProbed)
+        {
+            root->caps = probeCapabilities(a);
+            capsProbed = true;
+        }
+
         const QString path = archive_entry_pathname(entry);
         const auto size = archive_entry_size(entry);
 
         auto dirparts = path.split('/');
         const auto name = dirparts.takeLast();
 
-        ArchiveDir *current = root.get();
+        ArchiveDir *current = root;
         current->size_ += size;
 
         QString nodepath; // current nodepath per traversal
@@ -389,11 +551,7 @@ BuildTreeResult buildTree(const QString &filePath, const QString &childpath, con
             {
                 next = new ArchiveDir(current, dirpart, baseUrl.withChild(nodepath), 0);
                 current->children.push_back(next);
-
-                if (!child && (nodepath == childpath))
-                {
-                    child = next;
-                }
+                setChild(nodepath, next);
             }
 
             next->size_ += size; // update directory sizes
@@ -407,6 +565,11 @@ BuildTreeResult buildTree(const QString &filePath, const QString &childpath, con
             const auto size = archive_entry_size(entry);
             auto file = new ArchiveFile(current, name, baseUrl.withChild(nodepath), size);
 
+            // without compression, data starts right after the header consumed so far
+            file->stored_ = isStoredEntry(a, entry, root->caps);
+            if (file->stored_)
+                file->dataOffset_ = archive_filter_bytes(a, 0);
+
             if (archive_entry_birthtime_is_set(entry))
                 file->creationTime_ = QDateTime::fromMSecsSinceEpoch(archive_entry_birthtime(entry));
 
@@ -417,42 +580,31 @@ BuildTreeResult buildTree(const QString &filePath, const QString &childpath, con
                 file->lastAccessTime_ = QDateTime::fromMSecsSinceEpoch(archive_entry_atime(entry));
 
             current->children.push_back(file);
-            if (!child && (nodepath == childpath))
-            {
-                child = file;
-            }
+            setChild(nodepath, file);
         }
 
-        return false; // continue
+        l.unlock();
+        return progress && progress();
     };
 
-    if (!iterateArchiveEntries(filePath, insertFileNode))
-        return {};
-
-    return BuildTreeResult {std::move(root), child};
+    return iterateArchiveEntries(filePath, insertFileNode, cancel);
 }
 
-qint64 archiveChildfileSize(const QString &filePath, const QString &childpath)
+BuildTreeResult buildTree(const QString &filePath, const QString &childpath, const ArchiveUrl &baseUrl
+                          , const CancellationToken &cancel = {})
 {
-    qint64 childSize = -1;
-    const auto traverse = [&](archive *a, archive_entry *entry) {
-        QElapsedTimer timer;
-        timer.start();
-
-        // child always starts with '/'
-        const QString path = QString('/') + archive_entry_pathname(entry);
-        if (path != childpath)
-            return false;
+    std::unique_ptr<ArchiveDir> root {new ArchiveDir(nullptr, rootName(baseUrl), baseUrl, 0)};
+    ArchiveNode *child {};
 
-        childSize = archive_entry_size(entry);
-        return true; // break traversal
-    };
+    if (!fillTree(root.get(), filePath, childpath, baseUrl, &child, {}, cancel))
+        return {};
 
-    iterateArchiveEntries(filePath, traverse);
-    return childSize;
+    return BuildTreeResult {std::move(root), child};
 }
 
-void extractFile(const QString &filePath, const QString &childpath, QIODevice *output)
+// returns false if extraction was cancelled
+bool extractFile(const QString &filePath, const QString &childpath, QIODevice *output
+                 , const CancellationToken &cancel = {})
 {
     const auto extract = [&](archive *a, archive_entry *entry) {
         QElapsedTimer timer;
@@ -466,7 +618,7 @@ void extractFile(const QString &filePath, const QString &childpath, QIODevice *o
         const size_t bufsize = 1024 * 1024;
         std::unique_ptr<char[]> buf(new char[bufsize]);
         la_ssize_t readsize = 0;
-        while ((readsize = archive_read_data(a, buf.get(), bufsize)) > 0)
+        while (!cancel.isCancelled() && (readsize = archive_read_data(a, buf.get(), bufsize)) > 0)
         {
             output->write(buf.get(), readsize);
         }
@@ -475,10 +627,12 @@ void extractFile(const QString &filePath, const QString &childpath, QIODevice *o
         return true; // break traversal
     };
 
-    iterateArchiveEntries(filePath, extract);
+    iterateArchiveEntries(filePath, extract, cancel);
+    return !cancel.isCancelled();
 }
 
-std::shared_ptr<QTemporaryFile> extractFile(const QString &filePath, const QString &childPath)
+std::shared_ptr<QTemporaryFile> extractFile(const QString &filePath, const QString &childPath
+                                            , const CancellationToken &cancel = {})
 {
     const QDir tempdir(QDir::tempPath());
     const QString templateName = "XXXXXXXXXX." + QFileInfo(childPath).completeSuffix();
@@ -492,7 +646,8 @@ std::shared_ptr<QTemporaryFile> extractFile(const QString &filePath, const QStri
         return nullptr;
     }
 
-    extractFile(filePath, childPath, r.get());
+    if (!extractFile(filePath, childPath, r.get(), cancel))
+        return nullptr;
 
     // this is necessary to flush the content, otherwise reader may get invalid content
     r->close();
@@ -528,9 +683,10 @@ QString sourcePath(ArchiveDir *d, const ArchiveUrl &url)
 }
 
 
-std::unique_ptr<SharedDirectory> openFile(const QString &fileName, const QString &childName, const ArchiveUrl &baseUrl)
+std::unique_ptr<SharedDirectory> openFile(const QString &fileName, const QString &childName, const ArchiveUrl &baseUrl
+                                          , const CancellationToken &cancel = {})
 {
-    auto tree = buildTree(fileName, childName, baseUrl);
+    auto tree = buildTree(fileName, childName, baseUrl, cancel);
     if (!tree.root || (!tree.child != childName.isEmpty()))
         return nullptr;
 
@@ -546,12 +702,12 @@ std::unique_ptr<SharedDirectory> openFile(const QString &fileName, const QString
         return wrap(std::move(tree.root), childDir);
     }
 
-    auto tmp = extractFile(fileName, childName);
+    auto tmp = extractFile(fileName, childName, cancel);
     if (!tmp)
         return {};
 
     const auto newUrl = baseUrl.withChild(childName);
-    auto newroot = buildTree(tmp->fileName(), {}, newUrl);
+    auto newroot = buildTree(tmp->fileName(), {}, newUrl, cancel);
     if (!newroot.root) return nullptr;
     assert(!newroot.child);
 
@@ -561,26 +717,101 @@ std::unique_ptr<SharedDirectory> openFile(const QString &fileName, const QString
     return wrap(std::move(newroot.root), d);
 }
 
+/*
+ * returns as soon as the archive is recognized, entries are added to the returned
+ * directory in background, see IncrementalDirectory
+ *
+ * build runs on @pool, which doesn't share threads with archive readers, so waiting
+ * for the first entry can't be starved by them. if @pool is busy with other builds
+ * the archive is read completely here instead
+ */
+std::unique_ptr<SharedDirectory> openIncremental(QThreadPool *pool
+                                                 , const QString &fileName
+                                                 , const ArchiveUrl &baseUrl
+                                                 , const CancellationToken &cancel)
+{
+    auto root = std::make_shared<ArchiveDir>(nullptr, rootName(baseUrl), baseUrl, 0);
+    root->build = std::make_shared<TreeBuild>();
+
+    auto opened = std::make_shared<std::promise<bool>>();
+    auto openResult = opened->get_future();
+
+    const bool started = pool->tryStart([root, fileName, baseUrl, opened, cancel]()
+    {
+        bool reported = false;
+        const auto progress = [&]()
+        {
+            if (!reported)
+            {
+                opened->set_value(true);
+                reported = true;
+            }
+
+            root->build->notifier.entriesAdded();
+
+            // nobody else refers to the tree anymore or the request is gone, no point in finishing it
+            return root.use_count() == 1 || cancel.isCancelled();
+        };
+
+        const bool ok = fillTree(root.get(), fileName, {}, baseUrl, nullptr, progress, cancel);
+        root->build->notifier.finish();
+
+        // empty or unrecognized archive
+        if (!reported)
+            opened->set_value(ok);
+    });
+
+    if (!started)
+        return openFile(fileName, {}, baseUrl, cancel);
+
+    if (!openResult.get() || cancel.isCancelled())
+        return nullptr;
+
+    auto d = root.get();
+    return wrap(std::move(root), d);
+}
+
 
 } // namespace
 
 
 
 ArchiveSystem::ArchiveSystem()
+    : m_builds {std::make_unique<QThreadPool>()}
+{
+}
+
+// waits for builds which are still running, they stop once their directories are gone
+ArchiveSystem::~ArchiveSystem() = default;
+
+void ArchiveSystem::setIncrementalOpen(bool incremental)
+{
+    m_incremental = incremental;
+}
+
+bool ArchiveSystem::isArchiveUrl(const QUrl &url)
 {
+    return ArchiveUrl::isarchiveurl(url);
 }
 
-std::unique_ptr<Directory> ArchiveSystem::open(const QUrl &url)
+std::unique_ptr<Directory> ArchiveSystem::open(const QUrl &url, const CancellationToken &cancel)
 {
+    // incremental build stops once the request is cancelled or returned directory is gone
     if (url.isLocalFile())
     {
-        return openFile(url.toLocalFile(), {}, ArchiveUrl(url.toLocalFile()));
+        if (m_incremental)
+            return openIncremental(m_builds.get(), url.toLocalFile(), ArchiveUrl(url.toLocalFile()), cancel);
+
+        return openFile(url.toLocalFile(), {}, ArchiveUrl(url.toLocalFile()), cancel);
     }
     else if (ArchiveUrl::isarchiveurl(url))
     {
         const ArchiveUrl fullUrl(url);
+        if (fullUrl.childrenCount() == 0 && m_incremental)
+            return openIncremental(m_builds.get(), fullUrl.archivePath(), ArchiveUrl(fullUrl.archivePath()), cancel);
+
         if (fullUrl.childrenCount() == 0)
-            return openFile(fullUrl.archivePath(), {}, ArchiveUrl(fullUrl.archivePath()));
+            return openFile(fullUrl.archivePath(), {}, ArchiveUrl(fullUrl.archivePath()), cancel);
 
 
         auto currentPath = fullUrl.archivePath();
@@ -592,7 +823,7 @@ std::unique_ptr<Directory> ArchiveSystem::open(const QUrl &url)
         {
             assert(!currentPath.isEmpty());
 
-            current = openFile(currentPath, child, currentUrl);
+            current = openFile(currentPath, child, currentUrl, cancel);
             if (!current)
                 return nullptr;
 
@@ -613,7 +844,7 @@ std::unique_ptr<Directory> ArchiveSystem::open(const QUrl &url)
     return {};
 }
 
-std::unique_ptr<Directory> ArchiveSystem::open(const QString &path)
+std::unique_ptr<Directory> ArchiveSystem::open(const QString &path, const CancellationToken &cancel)
 {
     const QChar sep = '/';
 
@@ -637,18 +868,31 @@ std::unique_ptr<Directory> ArchiveSystem::open(const QString &path)
             return nullptr;
     }
 
-    // next 'parts' should be children in archive, visit each level to find the child
-    auto current = open(QUrl::fromLocalFile(filePath));
-    for (;current && piter != parts.end(); ++piter)
+    // next 'parts' should be children in archive
+    const QStringList children(piter, parts.end());
+    return openArchivePath(filePath, children.join(sep), cancel);
+}
+
+std::unique_ptr<Directory> ArchiveSystem::openArchivePath(const QString &archivePath
+                                                          , const QString &innerPath
+                                                          , const CancellationToken &cancel)
+{
+    // visit each level to find the child, tree has to be complete for the lookup,
+    // so this never opens incrementally
+    std::unique_ptr<Directory> current = openFile(archivePath, {}, ArchiveUrl(archivePath), cancel);
+    for (const auto &part : innerPath.split('/', Qt::SkipEmptyParts))
     {
+        if (!current)
+            return nullptr;
+
         std::unique_ptr<Directory> next;
 
         // TODO: may be we can optimize this linear search
         for (auto i = 0; i < current->fileCount(); ++i)
         {
-            if (current->fileName(i) == *piter)
+            if (current->fileName(i) == part)
             {
-                next = open(current.get(), i);
+                next = open(current.get(), i, cancel);
                 break;
             }
         }
@@ -662,7 +906,7 @@ std::unique_ptr<Directory> ArchiveSystem::open(const QString &path)
 
 
 // true returned value is SharedDirectory, it is useful to keep a reference to child directory
-std::unique_ptr<Directory> ArchiveSystem::open(Directory *dir, int child)
+std::unique_ptr<Directory> ArchiveSystem::open(Directory *dir, int child, const CancellationToken &cancel)
 {
     if (!dir || child < 0 || child >= dir->fileCount())
         return nullptr;
@@ -671,7 +915,10 @@ std::unique_ptr<Directory> ArchiveSystem::open(Directory *dir, int child)
     if (!wrapper)
         return nullptr;
 
+    QReadLocker l(wrapper->treeLock());
     auto dirnode = dynamic_cast<ArchiveDir * >(wrapper->d->children[child]);
+    l.unlock();
+
     if (dirnode)
         return wrap(wrapper->r, dirnode);
 
@@ -682,7 +929,7 @@ std::unique_ptr<Directory> ArchiveSystem::open(Directory *dir, int child)
         return {};
 
     const auto parentUrl = url.withoutLastChild();
-    return openFile(p, url.lastChild(), parentUrl);
+    return openFile(p, url.lastChild(), parentUrl, cancel);
 }
 
 std::unique_ptr<Directory> ArchiveSystem::dirParent(Directory *dir)
@@ -694,7 +941,7 @@ std::unique_ptr<Directory> ArchiveSystem::dirParent(Directory *dir)
     return wrap(wrapper->r, wrapper->d->parent_);
 }
 
-std::unique_ptr<IOSource> ArchiveSystem::iosource(Directory *dir, int child)
+std::unique_ptr<IOSource> ArchiveSystem::iosource(Directory *dir, int child, const CancellationToken &cancel)
 {
     auto result = std::make_unique<ArchiveTempIOSource>();
 
@@ -707,13 +954,82 @@ std::unique_ptr<IOSource> ArchiveSystem::iosource(Directory *dir, int child)
     if (p.isEmpty())
         return {};
 
-    result->file = extractFile(p, url.lastChild());
+    result->file = extractFile(p, url.lastChild(), cancel);
     if (!result->file)
         return {};
 
     return result;
 }
 
+namespace
+{
+
+// size of the tail region prefetched for containers which keep their index at the end
+qint64 tailPrefetchSize(qint64 fileSize)
+{
+    const qint64 minimum = 16 * 1024 * 1024;
+    return std::min(fileSize, std::max(minimum, fileSize / 32));
+}
+
+/*
+ * ISO base media files (mp4, mov, m4v, 3gp) are a sequence of boxes, the 'moov' box
+ * that the demuxer needs first may be near the start or at the very end of file,
+ * walk the top level boxes available in @head to find out.
+ */
+bool hasTrailingIndex(const QByteArray &head)
+{
+    const auto boxType = [&](qint64 offset) { return head.mid(offset + 4, 4); };
+    const auto boxSize = [&](qint64 offset) -> qint64 {
+        const auto *p = reinterpret_cast<const uchar *>(head.constData() + offset);
+        return (qint64(p[0]) << 24) | (qint64(p[1]) << 16) | (qint64(p[2]) << 8) | qint64(p[3]);
+    };
+
+    static const QByteArrayList leadingBoxes = {"ftyp", "moov", "mdat", "wide", "free", "skip"};
+    if (head.size() < 8 || !leadingBoxes.contains(boxType(0)))
+        return false;
+
+    qint64 offset = 0;
+    while (offset + 8 <= head.size()) {
+        const auto type = boxType(offset);
+        if (type == "moov")
+            return false;
+
+        if (type == "mdat")
+            return true;
+
+        const qint64 size = boxSize(offset);
+        if (size < 8)
+            break; // 64 bit or till-the-end box, can't walk further
+
+        offset += size;
+    }
+
+    // no 'moov' near the start, assume it's at the tail
+    return true;
+}
+
+}
+
+enum class ReadStrategy
+{
+    DirectRange,    // stored entry, read straight from the archive file
+    SeekableReader, // format supports seeking inside entries
+    CachedStream    // decoded sequentially once, random access served from cache
+};
+
+ReadStrategy readStrategy(const ArchiveCapabilities &caps, const ArchiveFile *file)
+{
+    if (file->stored_ && file->dataOffset_ >= 0)
+        return ReadStrategy::DirectRange;
+
+    if (caps.seekable)
+        return ReadStrategy::SeekableReader;
+
+    // libarchive can't checkpoint decoder state, so for streams (filters, solid
+    // blocks) the best we can do is to decode once and keep the output
+    return ReadStrategy::CachedStream;
+}
+
 class ArchiveTempIODevice : public IODevice
 {
 public:
@@ -725,6 +1041,8 @@ public:
     std::shared_ptr<ArchiveDir> r;
     ArchiveUrl url;
     qint64 size;
+    qint64 dataOffset = -1;
+    ReadStrategy strategy = ReadStrategy::CachedStream;
 
     std::unique_ptr<QIODevice> readDevice() override
     {
@@ -736,48 +1054,96 @@ public:
         if (childPath.startsWith("/"))
             childPath = childPath.removeFirst();
 
-        std::unique_ptr<QIODevice> archiveIODevice = nullptr;
-
-        // rar files support seemless seeking
-        if (p.endsWith(".rar"))
-            return std::unique_ptr<QIODevice>(new AsyncArchiveIODevice(p, childPath, size));
-        else
-            archiveIODevice.reset(new AsyncArchiveIODevice(p, childPath, size));
+        switch (strategy)
+        {
+        case ReadStrategy::DirectRange:
+            return std::make_unique<FileRangeDevice>(p, dataOffset, size);
+        case ReadStrategy::SeekableReader:
+            return std::make_unique<AsyncArchiveIODevice>(p, childPath, size, true);
+        case ReadStrategy::CachedStream:
+            break;
+        }
 
+        // cache serves random access, so one sequential reader is enough behind it
+        std::unique_ptr<QIODevice> archiveIODevice(new AsyncArchiveIODevice(p, childPath, size, false));
         if (!archiveIODevice->open(QIODevice::ReadOnly))
             return nullptr;
 
-        std::unique_ptr<CachedFileDevice> rDevice(new CachedFileDevice(archiveIODevice.get()));
-        archiveIODevice.release();
+        // peek is served from the device buffer, so the cache still gets these bytes
+        const bool prefetchTail = hasTrailingIndex(archiveIODevice->peek(4096));
+
+        auto source = archiveIODevice.release();
+        std::unique_ptr<CachedFileDevice> rDevice(new CachedFileDevice(source));
 
         QObject::connect(rDevice.get(),
                          &QIODevice::aboutToClose,
-                         archiveIODevice.get(),
+                         source,
                          &QIODevice::close);
         QObject::connect(rDevice.get(),
                          &QIODevice::aboutToClose,
-                         archiveIODevice.get(),
+                         source,
                          &QIODevice::deleteLater);
 
+        const qint64 tailStart = size - tailPrefetchSize(size);
+        if (prefetchTail && tailStart > 0) {
+            // player first seeks to the 'moov' box at the end, fetch it with a second
+            // reader while the head is being read, so that first frame doesn't wait for
+            // the whole entry to be decompressed
+            const auto factory = [p, childPath]() -> std::unique_ptr<QIODevice> {
+                return std::make_unique<ArchiveIODevice>(p, childPath);
+            };
+
+            rDevice->prefetch(tailStart, factory);
+        }
+
         return std::move(rDevice);
     }
 };
 
-std::unique_ptr<IODevice> ArchiveSystem::iodevice(Directory *dir, int child)
+// device reads lazily, so there is nothing long running to cancel here
+std::unique_ptr<IODevice> ArchiveSystem::iodevice(Directory *dir, int child, const CancellationToken &cancel)
 {
     auto wrapper = unwrap(dir);
-    if (!wrapper)
+    if (!wrapper || child < 0 || child >= dir->fileCount())
         return {}; // invalid input
 
-    const ArchiveUrl url{dir->fileUrl(child)};
+    if (cancel.isCancelled())
+        return {};
+
+    QReadLocker l(wrapper->treeLock());
+    auto file = dynamic_cast<ArchiveFile *>(wrapper->d->children[child]);
+    if (!file)
+        return {};
+
+    const ArchiveUrl url{file->url()};
     const auto p = sourcePath(wrapper->r.get(), url);
     if (p.isEmpty())
         return {};
 
-    auto size = archiveChildfileSize(p, url.lastChild());
+    // size and capabilities were collected while building the tree, no need to scan again
     auto result = std::make_unique<ArchiveTempIODevice>(url);
     result->r = wrapper->r;
-    result->size = size;
+    result->size = file->size();
+    result->dataOffset = file->dataOffset_;
+    result->strategy = readStrategy(wrapper->r->caps, file);
 
     return result;
 }
+
+QByteArray ArchiveSystem::version(const QUrl &url)
+{
+    QString archivePath;
+    if (url.isLocalFile())
+        archivePath = url.toLocalFile();
+    else if (ArchiveUrl::isarchiveurl(url))
+        archivePath = ArchiveUrl(url).archivePath();
+    else
+        return {};
+
+    const QFileInfo info(archivePath);
+    if (!info.isFile())
+        return {};
+
+    return QByteArray::number(info.size())
+           + ':' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+}
@@ -3,24 +3,48 @@
 
 #include "directorysystem.hpp"
 
+#include <atomic>
+#include <memory>
+
+class QThreadPool;
+
 class ArchiveSystem : public DirectorySystem
 {
 public:
     ArchiveSystem();
+    ~ArchiveSystem();
+
+    // top level of an archive is returned while its entries are still being read,
+    // see IncrementalDirectory
+    void setIncrementalOpen(bool incremental);
+
+    // url of a directory inside an archive
+    static bool isArchiveUrl(const QUrl &url);
+
+    // opens @innerPath of archive file at @archivePath, without looking for the archive in the path
+    std::unique_ptr<Directory> openArchivePath(const QString &archivePath
+                                               , const QString &innerPath
+                                               , const CancellationToken &cancel = {});
 
     // DirectorySystem interface
 public:
-    std::unique_ptr<Directory> open(const QUrl &url) override;
-    std::unique_ptr<Directory> open(const QString &path) override;
-    std::unique_ptr<Directory> open(Directory *dir, int child) override;
+    std::unique_ptr<Directory> open(const QUrl &url, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(const QString &path, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(Directory *dir, int child, const CancellationToken &cancel = {}) override;
 
     std::unique_ptr<Directory> dirParent(Directory *dir) override;
 
-    std::unique_ptr<IOSource> iosource(Directory *dir, int child) override;
-    std::unique_ptr<IODevice> iodevice(Directory *dir, int child) override;
+    std::unique_ptr<IOSource> iosource(Directory *dir, int child, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<IODevice> iodevice(Directory *dir, int child, const CancellationToken &cancel = {}) override;
+
+    // identity of the archive file, nested archives are covered by their outermost archive
+    QByteArray version(const QUrl &url) override;
 
 private:
+    std::atomic<bool> m_incremental {false};
 
+    // runs incremental builds, kept apart from global pool where archive readers park
+    std::unique_ptr<QThreadPool> m_builds;
 };
 
 
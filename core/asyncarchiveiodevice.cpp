@@ -2,51 +2,144 @@
 #include <QElapsedTimer>
 #include "directorysystem.hpp"
 #include <qdebug.h>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+// upper bound of concurrent readers, each reader holds its own ring buffer
+constexpr size_t MAX_READERS = 3;
+
+// a cursor is reused for a read if the read is this far ahead of it, reading
+// forward is cheaper than repositioning a reader (data is likely buffered already)
+constexpr qint64 NEAR_DISTANCE = 4 * 1024 * 1024;
+
+// cursors not used in these many reads are retired
+constexpr quint64 IDLE_ACCESSES = 512;
 
 AsyncArchiveIODevice::AsyncArchiveIODevice(QString archivePath,
                                            QString childPath,
                                            qint64 fileSize,
+                                           bool seekable,
                                            QObject *parent)
-    : m_archivePath{archivePath}
+    : QIODevice{parent}
+    , m_archivePath{archivePath}
     , m_childPath{childPath}
     , m_fileSize{fileSize}
+    , m_seekable{seekable}
+    , m_readerSeekable{seekable}
 {}
 
 AsyncArchiveIODevice::~AsyncArchiveIODevice()
 {
-    releaseReader();
+    releaseReaders();
 }
 
-void AsyncArchiveIODevice::resetReader()
+AsyncArchiveIODevice::Cursor *AsyncArchiveIODevice::selectCursor(qint64 pos)
 {
-    releaseReader();
+    ++m_accessCount;
+
+    Cursor *nearest = nullptr;
+    qint64 nearestDistance = std::numeric_limits<qint64>::max();
+    for (const auto &cursor : m_cursors) {
+        // backward inside the buffer or a little ahead of the cursor
+        const bool inBuffer = pos >= cursor->readerStartPos
+                              && pos < cursor->readerStartPos + cursor->buf.size();
+        const qint64 ahead = pos - cursor->pos();
+        if (!inBuffer && (ahead < 0 || ahead > NEAR_DISTANCE))
+            continue;
+
+        const qint64 distance = std::abs(ahead);
+        if (distance < nearestDistance) {
+            nearest = cursor.get();
+            nearestDistance = distance;
+        }
+    }
 
-    m_buf.clear();
-    m_bufferPos = 0;
-    m_readerStartPos = pos();
+    if (!nearest) {
+        if (m_seekable && m_readerSeekable && m_cursors.size() < MAX_READERS) {
+            nearest = addCursor(pos);
+        } else {
+            // reposition the least recently used reader
+            nearest = std::min_element(m_cursors.begin(),
+                                       m_cursors.end(),
+                                       [](const auto &l, const auto &r) {
+                                           return l->lastAccess < r->lastAccess;
+                                       })
+                          ->get();
+        }
+    }
+
+    nearest->lastAccess = m_accessCount;
+    m_current = nearest;
+
+    retireIdleCursors();
+    return nearest;
+}
+
+AsyncArchiveIODevice::Cursor *AsyncArchiveIODevice::addCursor(qint64 pos)
+{
+    m_cursors.push_back(std::make_unique<Cursor>());
+
+    auto cursor = m_cursors.back().get();
+    cursor->lastAccess = m_accessCount;
+    resetReader(cursor, pos);
+    return cursor;
+}
+
+void AsyncArchiveIODevice::retireIdleCursors()
+{
+    for (auto it = m_cursors.begin(); it != m_cursors.end();) {
+        Cursor *cursor = it->get();
+        const bool idle = (m_accessCount - cursor->lastAccess) > IDLE_ACCESSES;
+
+        // without seek support, extra readers only waste decompression
+        if (cursor != m_current && (idle || !m_seekable || !m_readerSeekable)) {
+            releaseReader(cursor);
+            it = m_cursors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void AsyncArchiveIODevice::resetReader(Cursor *cursor, qint64 pos)
+{
+    releaseReader(cursor);
+
+    cursor->buf.clear();
+    cursor->bufferPos = 0;
+    cursor->readerStartPos = pos;
+
+    AsyncArchiveFileReader *reader = new AsyncArchiveFileReader;
+    cursor->reader = reader;
+    ++m_readersStarted;
+
+    connect(reader, &AsyncArchiveFileReader::dataAvailable, this, [this, reader]() {
+        if (m_current && m_current->reader == reader)
+            emit readyRead();
+    });
+    connect(reader, &AsyncArchiveFileReader::finished, this, [this, reader]() {
+        if (!m_current || m_current->reader != reader)
+            return;
 
-    m_reader = new AsyncArchiveFileReader;
-    connect(m_reader, &AsyncArchiveFileReader::dataAvailable, this, &QIODevice::readyRead);
-    connect(m_reader, &AsyncArchiveFileReader::finished, this, [this]() {
         // Emit readyRead one last time in case there's remaining data
-        if (m_buf.size() - m_bufferPos > 0) {
+        if (m_current->buf.size() - m_current->bufferPos > 0) {
             emit readyRead();
         }
 
         emit readChannelFinished();
     });
-    connect(m_reader, &AsyncArchiveFileReader::error, this, [this](const QString &message) {
+    connect(reader, &AsyncArchiveFileReader::error, this, [this](const QString &message) {
         setErrorString(message);
     });
 
-    qInfo() << "AsyncArchiveIODevice::resetReader startin read" << pos();
-    m_reader->start(m_archivePath, m_childPath, m_readerStartPos);
+    qInfo() << "AsyncArchiveIODevice::resetReader startin read" << pos;
+    reader->start(m_archivePath, m_childPath, cursor->readerStartPos);
 }
 
-bool AsyncArchiveIODevice::repositionReader()
+bool AsyncArchiveIODevice::repositionReader(Cursor *cursor, qint64 currentPos)
 {
-    const qint64 currentPos = pos();
-    const qint64 expectedBufferStart = m_readerStartPos + m_bufferPos;
+    const qint64 expectedBufferStart = cursor->pos();
 
     // Check if position has been changed externally (not matching our buffer state)
     if (currentPos != expectedBufferStart) {
@@ -65,18 +158,18 @@ bool AsyncArchiveIODevice::repositionReader()
 
             while (bytesToSkip > 0) {
                 // Try to skip within current buffer first
-                qint64 availableInBuffer = m_buf.size() - m_bufferPos;
+                qint64 availableInBuffer = cursor->buf.size() - cursor->bufferPos;
                 qint64 skipInBuffer = qMin(bytesToSkip, availableInBuffer);
 
                 if (skipInBuffer > 0) {
-                    m_bufferPos += skipInBuffer;
+                    cursor->bufferPos += skipInBuffer;
                     bytesToSkip -= skipInBuffer;
                     qDebug() << "Skipped" << skipInBuffer
                              << "bytes in buffer, remaining:" << bytesToSkip;
                 }
 
                 // If we still need to skip more, fetch and discard new data
-                if (bytesToSkip > 0 && m_bufferPos >= m_buf.size()) {
+                if (bytesToSkip > 0 && cursor->bufferPos >= cursor->buf.size()) {
                     const bool hitTimeLimit = readTimer.elapsed() > 100;
                     if (hitTimeLimit || m_readerSeekable) {
                         if (hitTimeLimit)
@@ -84,42 +177,42 @@ bool AsyncArchiveIODevice::repositionReader()
                         else
                             qDebug() << "reader seekable, attempting direct seek";
 
-                        seekOrResetReader(m_readerStartPos + m_bufferPos + bytesToSkip);
+                        seekOrResetReader(cursor, cursor->pos() + bytesToSkip);
                         break;
                     }
 
-                    m_reader->getAvailableData(m_buf);
-                    m_readerStartPos += m_buf.size(); // Update position for old buffer
-                    m_bufferPos = 0;
+                    cursor->readerStartPos += cursor->buf.size(); // Update position for old buffer
+                    cursor->reader->getAvailableData(cursor->buf);
+                    cursor->bufferPos = 0;
 
-                    if (m_buf.isEmpty()) {
+                    if (cursor->buf.isEmpty()) {
                         // No more data available to skip
                         qDebug() << "No more data available, cannot skip remaining" << bytesToSkip
                                  << "bytes";
                         return false;
                     }
 
-                    qDebug() << "Fetched new buffer of size" << m_buf.size();
+                    qDebug() << "Fetched new buffer of size" << cursor->buf.size();
                 }
 
                 // Safety check to avoid infinite loop
-                if (m_bufferPos >= m_buf.size() && bytesToSkip > 0) {
+                if (cursor->bufferPos >= cursor->buf.size() && bytesToSkip > 0) {
                     break;
                 }
             }
         } else if (bytesToSkip < 0) {
             // Backward seek - check if it's within current buffer
-            qint64 offsetFromReaderStart = currentPos - m_readerStartPos;
+            qint64 offsetFromReaderStart = currentPos - cursor->readerStartPos;
 
-            if (offsetFromReaderStart >= 0 && offsetFromReaderStart < m_buf.size()) {
+            if (offsetFromReaderStart >= 0 && offsetFromReaderStart < cursor->buf.size()) {
                 // Can handle backward seek within buffer
                 qDebug() << "Backward seek within buffer - adjusting position to"
                          << offsetFromReaderStart;
-                m_bufferPos = offsetFromReaderStart;
+                cursor->bufferPos = offsetFromReaderStart;
             } else {
                 // Backward seek outside buffer - use reader seek or reset
                 qDebug() << "Backward seek outside buffer - attempting reader seek";
-                seekOrResetReader(currentPos);
+                seekOrResetReader(cursor, currentPos);
             }
         }
     }
@@ -127,58 +220,67 @@ bool AsyncArchiveIODevice::repositionReader()
     return true;
 }
 
-void AsyncArchiveIODevice::releaseReader()
+void AsyncArchiveIODevice::releaseReader(Cursor *cursor)
 {
-    if (m_reader) {
-        m_reader->abort();
-        m_reader->disconnect(this);
-        m_reader->deleteLater();
-        m_reader = nullptr;
+    if (cursor->reader) {
+        cursor->reader->abort();
+        cursor->reader->disconnect(this);
+        cursor->reader->deleteLater();
+        cursor->reader = nullptr;
     }
 }
 
-void AsyncArchiveIODevice::seekOrResetReader(qint64 pos)
+void AsyncArchiveIODevice::releaseReaders()
+{
+    for (const auto &cursor : m_cursors)
+        releaseReader(cursor.get());
+
+    m_cursors.clear();
+    m_current = nullptr;
+}
+
+void AsyncArchiveIODevice::seekOrResetReader(Cursor *cursor, qint64 pos)
 {
-    if (m_reader->seek(pos)) {
-        m_readerStartPos = pos;
-        m_buf.clear();
-        m_bufferPos = 0;
-        m_readerSeekable = true;
+    if (cursor->reader->seek(pos)) {
+        cursor->readerStartPos = pos;
+        cursor->buf.clear();
+        cursor->bufferPos = 0;
     } else {
         qDebug() << "reader seek failed, resetting reader";
         m_readerSeekable = false;
-        resetReader();
+        resetReader(cursor, pos);
     }
 }
 
 qint64 AsyncArchiveIODevice::readData(char *data, qint64 maxlen)
 {
-    if (!m_reader || maxlen <= 0) {
+    if (m_cursors.empty() || maxlen <= 0) {
         return 0;
     }
 
-    if (!repositionReader())
+    Cursor *cursor = selectCursor(pos());
+    if (!repositionReader(cursor, pos()))
         return -1;
 
     qint64 totalRead = 0;
     // If we've exhausted the buffer, get more data
-    if (m_bufferPos >= m_buf.size() && totalRead == 0) {
-        m_readerStartPos += m_buf.size(); // Update position for old buffer
-        m_reader->getAvailableData(m_buf);
-        m_bufferPos = 0;
-        if (m_buf.isEmpty()) // No more data available
-            return -1;       // nothing to read
+    if (cursor->bufferPos >= cursor->buf.size() && totalRead == 0) {
+        cursor->readerStartPos += cursor->buf.size(); // Update position for old buffer
+        cursor->reader->getAvailableData(cursor->buf);
+        cursor->bufferPos = 0;
+        if (cursor->buf.isEmpty()) // No more data available
+            return -1;             // nothing to read
     }
 
     // First, try to read from our internal buffer
-    qint64 toRead = qMin(maxlen - totalRead, (qint64) m_buf.size() - m_bufferPos);
+    qint64 toRead = qMin(maxlen - totalRead, (qint64) cursor->buf.size() - cursor->bufferPos);
     if (toRead > 0) { // Only copy if there's data to copy
-        memcpy(data + totalRead, m_buf.constData() + m_bufferPos, toRead);
+        memcpy(data + totalRead, cursor->buf.constData() + cursor->bufferPos, toRead);
         totalRead += toRead;
-        m_bufferPos += toRead;
+        cursor->bufferPos += toRead;
     }
 
-    return totalRead == 0 && (!m_reader || m_reader->isFinished()) ? -1 : totalRead;
+    return totalRead == 0 && (!cursor->reader || cursor->reader->isFinished()) ? -1 : totalRead;
 }
 
 qint64 AsyncArchiveIODevice::writeData(const char *data, qint64 len)
@@ -197,7 +299,8 @@ bool AsyncArchiveIODevice::open(OpenMode mode)
     if (mode != QIODevice::ReadOnly)
         return false;
 
-    resetReader();
+    releaseReaders();
+    m_current = addCursor(0);
     return QIODevice::open(mode);
 }
 
@@ -211,21 +314,21 @@ bool AsyncArchiveIODevice::seek(qint64 newpos)
     if (newpos >= m_fileSize)
         return false;
 
-    const qint64 oldPos = pos();
-    bool s = QIODevice::seek(newpos);
-    if (s && oldPos != pos())
-        return repositionReader();
-
-    return s;
+    // readers are picked and repositioned on next read, based on where it lands
+    return QIODevice::seek(newpos);
 }
 
 qint64 AsyncArchiveIODevice::bytesAvailable() const
 {
-    return (m_buf.size() - m_bufferPos) + ((m_reader) ? m_reader->bytesAvailable() : 0);
+    if (!m_current)
+        return 0;
+
+    return (m_current->buf.size() - m_current->bufferPos)
+           + ((m_current->reader) ? m_current->reader->bytesAvailable() : 0);
 }
 
 void AsyncArchiveIODevice::close()
 {
-    releaseReader();
+    releaseReaders();
     QIODevice::close();
 }
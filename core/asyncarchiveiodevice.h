@@ -3,15 +3,20 @@
 
 #include <QIODevice>
 #include <QPointer>
+#include <memory>
+#include <vector>
 #include "AsyncArchiveFileReader.h"
 
 class AsyncArchiveIODevice : public QIODevice
 {
     Q_OBJECT
 public:
+    // @seekable tells whether readers of the entry can seek, only then scattered reads
+    // get readers of their own, otherwise every reader decompresses from the start
     AsyncArchiveIODevice(QString archivePath,
                          QString childPath,
                          qint64 fileSize,
+                         bool seekable = false,
                          QObject *parent = nullptr);
     ~AsyncArchiveIODevice();
 
@@ -22,25 +27,53 @@ public:
     qint64 bytesAvailable() const;
     void close();
 
+    // readers started since construction and readers alive now
+    int readersStarted() const { return m_readersStarted; }
+    int readerCount() const { return int(m_cursors.size()); }
+
 protected:
     qint64 readData(char *data, qint64 maxlen);
     qint64 writeData(const char *data, qint64 len);
 
 private:
-    void resetReader();
-    bool repositionReader();
-    void releaseReader();
-    void seekOrResetReader(qint64 pos);
+    // independent reader positioned somewhere in the file, for seekable formats
+    // we keep a few of these so that scattered access doesn't thrash a single reader
+    struct Cursor
+    {
+        QPointer<AsyncArchiveFileReader> reader;
+        QByteArray buf;
+        qint64 bufferPos = 0;
+        qint64 readerStartPos = 0;
+        quint64 lastAccess = 0;
+
+        // position of the next byte this cursor will deliver
+        qint64 pos() const { return readerStartPos + bufferPos; }
+    };
+
+    Cursor *selectCursor(qint64 pos);
+    Cursor *addCursor(qint64 pos);
+    void retireIdleCursors();
+
+    void resetReader(Cursor *cursor, qint64 pos);
+    bool repositionReader(Cursor *cursor, qint64 pos);
+    void releaseReader(Cursor *cursor);
+    void releaseReaders();
+    void seekOrResetReader(Cursor *cursor, qint64 pos);
 
     const QString m_archivePath;
     const QString m_childPath;
     const qint64 m_fileSize;
-    QPointer<AsyncArchiveFileReader> m_reader;
 
-    QByteArray m_buf;
-    qint64 m_bufferPos = 0;
-    qint64 m_readerStartPos = 0;
-    bool m_readerSeekable = true;
+    std::vector<std::unique_ptr<Cursor>> m_cursors;
+    Cursor *m_current = nullptr;
+    quint64 m_accessCount = 0;
+
+    const bool m_seekable;
+
+    // cleared once a reader fails to seek
+    bool m_readerSeekable;
+
+    int m_readersStarted = 0;
 };
 
 #endif // ASYNCARCHIVEIODEVICE_H
@@ -0,0 +1,38 @@
+#ifndef CANCELLATIONTOKEN_HPP
+#define CANCELLATIONTOKEN_HPP
+
+#include <atomic>
+#include <memory>
+
+// lets a superseded request stop long running work (archive scans, extraction,
+// directory listing), copies share the same flag, a default constructed token
+// is never cancelled
+class CancellationToken
+{
+public:
+    static CancellationToken create()
+    {
+        CancellationToken token;
+        token.m_flag = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    void cancel() const
+    {
+        if (m_flag)
+            m_flag->store(true, std::memory_order_relaxed);
+    }
+
+    bool isCancelled() const
+    {
+        return m_flag && m_flag->load(std::memory_order_relaxed);
+    }
+
+    // for code which isn't Qt aware, null if token can't be cancelled
+    const std::atomic<bool> *flag() const { return m_flag.get(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_flag;
+};
+
+#endif // CANCELLATIONTOKEN_HPP
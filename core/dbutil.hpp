@@ -59,4 +59,16 @@ static bool enableAutoVacuum(QSqlDatabase &db)
     return true;
 }
 
+// unlike FULL, free pages are only reclaimed on "PRAGMA incremental_vacuum"
+static bool enableIncrementalVacuum(QSqlDatabase &db)
+{
+    if (!executeQuery(db, "PRAGMA auto_vacuum = INCREMENTAL"))
+    {
+        qWarning() << "Failed to enable incremental vacuum.";
+        return false;
+    }
+
+    return true;
+}
+
 #endif // DBUTIL_HPP
@@ -5,6 +5,21 @@
 #include <QDateTime>
 
 
+namespace
+{
+
+// position of an entry in random sort, biased by creation time
+double randomSortKey(int32_t seed, const QString &name, qint64 creationTime)
+{
+    double biasWeight = .6f;
+    const auto random = qHash(seed ^ qHash(name));
+    const auto bias = creationTime;
+
+    return (random * (1.0 - biasWeight)) + (bias * biasWeight);
+}
+
+}
+
 DirectorySortModel::DirectorySortModel(QObject *parent)
     : QSortFilterProxyModel{parent}
 {
@@ -14,17 +29,12 @@ DirectorySortModel::DirectorySortModel(QObject *parent)
     connect(this, &QSortFilterProxyModel::sourceModelChanged, this, [this]()
     {
         const auto src = sourceModel();
-        const auto triggerOn = [&](auto signal)
-        {
-            connect(src, signal
-                    , this, &DirectorySortModel::handleRandomValuesOnModelChange);
-        };
-
-        triggerOn(&QAbstractItemModel::modelReset);
-        triggerOn(&QAbstractItemModel::layoutChanged);
-        triggerOn(&QAbstractItemModel::rowsInserted);
-        triggerOn(&QAbstractItemModel::rowsMoved);
-        triggerOn(&QAbstractItemModel::rowsRemoved);
+        m_directoryModel = qobject_cast<DirectorySystemModel *>(src);
+
+        // only a new directory is reshuffled, rows inserted, removed or moved by changes
+        // on disk are placed by the current seed so the view holds still
+        connect(src, &QAbstractItemModel::modelReset
+                , this, &DirectorySortModel::handleRandomValuesOnModelChange);
     });
 }
 
@@ -38,16 +48,19 @@ void DirectorySortModel::sort(int column, Qt::SortOrder order)
 
 bool DirectorySortModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
 {
-    const auto identifier = [](const auto seed, const QModelIndex &index) -> double
+    // sorting asks for O(n log n) comparisons, going through data() costs a QVariant each
+    if (m_directoryModel && sortRole() == DirectorySystemModel::DataRole)
     {
-        double biasWeight = .6f;
-        const auto random = qHash(seed ^ qHash(index.data(DirectorySystemModel::NameRole).toString()));
+        return columnLessThan(m_directoryModel->directoryIndex(source_left.row())
+                              , m_directoryModel->directoryIndex(source_right.row())
+                              , source_left, source_right);
+    }
 
-        // Bias using creation time
+    const auto identifier = [](const auto seed, const QModelIndex &index) -> double
+    {
         const auto creationTime = index.siblingAtColumn(DirectorySystemModel::CreationTimeColumn).data(DirectorySystemModel::DataRole).toDateTime();
-        const auto bias = creationTime.isValid() ? creationTime.toMSecsSinceEpoch() : 0;
-
-        return (random * (1.0 - biasWeight)) + (bias * biasWeight);
+        return randomSortKey(seed, index.data(DirectorySystemModel::NameRole).toString()
+                             , DirectoryColumns::toMSecs(creationTime));
     };
 
     if (m_randomSort)
@@ -74,6 +87,57 @@ bool DirectorySortModel::lessThan(const QModelIndex &source_left, const QModelIn
     return QSortFilterProxyModel::lessThan(source_left, source_right);
 }
 
+bool DirectorySortModel::columnLessThan(int left, int right, const QModelIndex &source_left, const QModelIndex &source_right) const
+{
+    const auto &columns = m_directoryModel->columns();
+
+    const auto identifier = [&columns](const auto seed, int i) -> double
+    {
+        return randomSortKey(seed, columns.names[i], columns.creationTimes[i]);
+    };
+
+    if (m_randomSort)
+    {
+        const bool result = identifier(m_randomSeed, left) > identifier(m_randomSeed, right);
+        return sortOrder() == Qt::AscendingOrder ? result : !result;
+    }
+
+    if (sortColumn() == DirectorySystemModel::NameColumn)
+    {
+        const bool leftDir = columns.dirs[left];
+        const bool rightDir = columns.dirs[right];
+        if (leftDir != rightDir)
+        {
+            return sortOrder() == Qt::AscendingOrder ? leftDir : rightDir;
+        }
+    }
+
+    // same rules QSortFilterProxyModel applies to strings
+    const auto stringLessThan = [this](const QString &l, const QString &r)
+    {
+        return isSortLocaleAware() ? QString::localeAwareCompare(l, r) < 0
+                                   : QString::compare(l, r, sortCaseSensitivity()) < 0;
+    };
+
+    switch (sortColumn())
+    {
+    case DirectorySystemModel::NameColumn:
+        return stringLessThan(columns.names[left], columns.names[right]);
+    case DirectorySystemModel::PathColumn:
+        return stringLessThan(columns.paths[left], columns.paths[right]);
+    case DirectorySystemModel::SizeColumn:
+        return columns.sizes[left] < columns.sizes[right];
+    case DirectorySystemModel::LastAccessTimeColumn:
+        return columns.lastAccessTimes[left] < columns.lastAccessTimes[right];
+    case DirectorySystemModel::CreationTimeColumn:
+        return columns.creationTimes[left] < columns.creationTimes[right];
+    case DirectorySystemModel::ModifedTimeColumn:
+        return columns.modifiedTimes[left] < columns.modifiedTimes[right];
+    }
+
+    return QSortFilterProxyModel::lessThan(source_left, source_right);
+}
+
 void DirectorySortModel::handleRandomValuesOnModelChange()
 {
     if (sender() != sourceModel())
@@ -100,7 +164,9 @@ void DirectorySortModel::setOnlyShowVideoFile(bool newOnlyShowVideoFile)
 bool DirectorySortModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
 {
     const auto src = sourceModel();
-    const auto path = src->data(src->index(source_row, 0), DirectorySystemModel::PathRole).toString();
+    const auto path = m_directoryModel
+                          ? m_directoryModel->columns().paths[m_directoryModel->directoryIndex(source_row)]
+                          : src->data(src->index(source_row, 0), DirectorySystemModel::PathRole).toString();
     if (path.endsWith(".!qB"))
         return false;
 
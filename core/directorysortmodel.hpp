@@ -3,6 +3,8 @@
 
 #include <QSortFilterProxyModel>
 
+class DirectorySystemModel;
+
 class DirectorySortModel : public QSortFilterProxyModel
 {
     Q_OBJECT
@@ -44,6 +46,12 @@ protected:
 private:
     void handleRandomValuesOnModelChange();
 
+    // compares directory indexes of source on its columns
+    bool columnLessThan(int left, int right, const QModelIndex &source_left, const QModelIndex &source_right) const;
+
+    // set when source is a DirectorySystemModel
+    DirectorySystemModel *m_directoryModel = nullptr;
+
     bool m_randomSort = false;
     int32_t m_randomSeed = 0x1234; // Single seed value
     bool m_onlyShowVideoFile = false;
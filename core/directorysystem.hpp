@@ -3,19 +3,91 @@
 
 #include <QDateTime>
 #include <QFile>
+#include <QFlags>
+#include <QList>
 #include <QString>
+#include <QStringList>
 #include <QUrl>
+#include <functional>
 #include <memory>
 
+#include "cancellationtoken.hpp"
+
 // ALL functions must be thread-safe
 // ALL functions of interface can be called from any number of threads
 
+// DirectorySystem implementation which returned a directory
+enum class DirectoryType
+{
+    Other,
+    FileSystem,
+    Archive
+};
+
+// children properties of a range of entries, one array per field, lets callers which
+// need a property of many entries read it in one go instead of one call per entry
+struct DirectoryColumns
+{
+    enum Field
+    {
+        Names = 0x01,
+        Paths = 0x02,
+        Sizes = 0x04,
+        Dirs = 0x08,
+        LastAccessTimes = 0x10,
+        CreationTimes = 0x20,
+        ModifiedTimes = 0x40,
+
+        AllFields = 0x7f
+    };
+
+    Q_DECLARE_FLAGS(Fields, Field)
+
+    // only requested fields are filled, others stay empty
+    QStringList names;
+    QStringList paths;
+    QList<qint64> sizes;
+    QList<bool> dirs;
+
+    // msecs since epoch, 0 if not available
+    QList<qint64> lastAccessTimes;
+    QList<qint64> creationTimes;
+    QList<qint64> modifiedTimes;
+
+    static qint64 toMSecs(const QDateTime &time) { return time.isValid() ? time.toMSecsSinceEpoch() : 0; }
+    static QDateTime fromMSecs(qint64 msecs) { return msecs != 0 ? QDateTime::fromMSecsSinceEpoch(msecs) : QDateTime {}; }
+
+    void clear() { *this = {}; }
+
+    void remove(int first, int count)
+    {
+        const auto removeFrom = [first, count](auto &column)
+        {
+            if (!column.isEmpty())
+                column.remove(first, count);
+        };
+
+        removeFrom(names);
+        removeFrom(paths);
+        removeFrom(sizes);
+        removeFrom(dirs);
+        removeFrom(lastAccessTimes);
+        removeFrom(creationTimes);
+        removeFrom(modifiedTimes);
+    }
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(DirectoryColumns::Fields)
+
 // Directory is only observer, no operation can be applied
 class Directory
 {
 public:
     virtual ~Directory() = default;
 
+    // lets composite systems dispatch a directory back to the system which returned it
+    virtual DirectoryType type() const { return DirectoryType::Other; }
+
     virtual QString path() = 0;
     virtual QString name() = 0;
     virtual QUrl url() = 0;
@@ -36,6 +108,83 @@ public:
     virtual QDateTime fileModifiedTime(int i) = 0;
 
     virtual bool isLinearDir() const { return false; }
+
+    // appends @fields of entries [@first, @first + @count) to @columns, implementations
+    // should override this to read their storage directly and take their lock once
+    virtual void fill(int first, int count, DirectoryColumns::Fields fields, DirectoryColumns &columns)
+    {
+        for (int i = first; i < first + count; ++i)
+        {
+            if (fields & DirectoryColumns::Names)
+                columns.names.push_back(fileName(i));
+            if (fields & DirectoryColumns::Paths)
+                columns.paths.push_back(filePath(i));
+            if (fields & DirectoryColumns::Sizes)
+                columns.sizes.push_back(fileSize(i));
+            if (fields & DirectoryColumns::Dirs)
+                columns.dirs.push_back(isDir(i));
+            if (fields & DirectoryColumns::LastAccessTimes)
+                columns.lastAccessTimes.push_back(DirectoryColumns::toMSecs(fileLastAccessTime(i)));
+            if (fields & DirectoryColumns::CreationTimes)
+                columns.creationTimes.push_back(DirectoryColumns::toMSecs(fileCreationTime(i)));
+            if (fields & DirectoryColumns::ModifiedTimes)
+                columns.modifiedTimes.push_back(DirectoryColumns::toMSecs(fileModifiedTime(i)));
+        }
+    }
+};
+
+
+// optional, implemented by directories which are still being filled when open()
+// returns, entries are only appended, so fileCount() grows till isComplete()
+class IncrementalDirectory
+{
+public:
+    // called from the loading thread after a batch of entries is appended and
+    // once more after loading is complete
+    using ProgressCallback = std::function<void ()>;
+
+    virtual ~IncrementalDirectory() = default;
+
+    virtual bool isComplete() = 0;
+
+    // replaces the previous callback, once this returns previous callback won't be called
+    virtual void setProgressCallback(ProgressCallback cb) = 0;
+};
+
+
+// rows are inclusive, Inserted rows are always appended
+struct DirectoryChange
+{
+    enum Type
+    {
+        Inserted,
+        Removed,
+        Updated
+    };
+
+    Type type;
+    int first;
+    int last;
+};
+
+// optional, implemented by directories which can follow changes on disk after open()
+class WatchedDirectory
+{
+public:
+    // called from the watching thread when changes are pending
+    using ChangeCallback = std::function<void ()>;
+    using ChangeHandler = std::function<void (const DirectoryChange &change)>;
+
+    virtual ~WatchedDirectory() = default;
+
+    // changes are only followed while a callback is set, once this returns
+    // previous callback won't be called
+    virtual void setChangeCallback(ChangeCallback cb) = 0;
+
+    // applies pending changes one at a time, @before and @after are called around
+    // each so that a model can bracket it with its begin/end notifications, rows
+    // don't change outside of this
+    virtual void applyChanges(const ChangeHandler &before, const ChangeHandler &after) = 0;
 };
 
 
@@ -57,20 +206,25 @@ public:
     virtual std::unique_ptr<QIODevice> readDevice() = 0;
 };
 
+// once @cancel is cancelled, functions taking it return as soon as possible with an empty result
 class DirectorySystem
 {
 public:
     virtual ~DirectorySystem() = default;
 
-    virtual std::unique_ptr<Directory> open(const QUrl &url) = 0;
-    virtual std::unique_ptr<Directory> open(const QString &path) = 0;
-    virtual std::unique_ptr<Directory> open(Directory *dir, int child) = 0;
+    virtual std::unique_ptr<Directory> open(const QUrl &url, const CancellationToken &cancel = {}) = 0;
+    virtual std::unique_ptr<Directory> open(const QString &path, const CancellationToken &cancel = {}) = 0;
+    virtual std::unique_ptr<Directory> open(Directory *dir, int child, const CancellationToken &cancel = {}) = 0;
 
     virtual std::unique_ptr<Directory> dirParent(Directory *dir) = 0;
 
-    virtual std::unique_ptr<IOSource> iosource(Directory *dir, int child) = 0;
+    virtual std::unique_ptr<IOSource> iosource(Directory *dir, int child, const CancellationToken &cancel = {}) = 0;
+
+    virtual std::unique_ptr<IODevice> iodevice(Directory *dir, int child, const CancellationToken &cancel = {}) { return nullptr; }
 
-    virtual std::unique_ptr<IODevice> iodevice(Directory *dir, int child) { return nullptr; }
+    // cheap identity of the source open(@url) reads, i.e. directory's or archive's
+    // modification time, changes whenever the listing may have changed, empty if unknown
+    virtual QByteArray version(const QUrl &url) { return {}; }
 };
 
 
@@ -3,24 +3,71 @@
 #include "directorysystem.hpp"
 #include "filehistorydb.hpp"
 
+#include <QCoreApplication>
 #include <QTextStream>
 #include <QDir>
 
+#include <numeric>
+
 namespace
 {
 
-QString formatSize(qint64 size) {
-    const auto l = QLocale::system();
+// rows out of order after an in place update are moved one by one up to this,
+// beyond that layout is changed in one go
+constexpr int MAX_ROW_MOVES = 32;
+
+// entries formatted for display at a time, about a few screens of rows
+constexpr int DISPLAY_BATCH = 128;
+
+bool sameEntry(const DirectoryColumns &l, int li, const DirectoryColumns &r, int ri)
+{
+    return l.dirs[li] == r.dirs[ri]
+           && l.sizes[li] == r.sizes[ri]
+           && l.modifiedTimes[li] == r.modifiedTimes[ri]
+           && l.creationTimes[li] == r.creationTimes[ri]
+           && l.lastAccessTimes[li] == r.lastAccessTimes[ri];
+}
+
+// positions of a longest strictly increasing subsequence of @values
+QVector<bool> increasingSubsequence(const QVector<int> &values)
+{
+    QVector<int> tails;    // position of smallest tail for each length
+    QVector<int> previous(values.size(), -1);
+
+    for (int i = 0; i < values.size(); ++i)
+    {
+        const auto it = std::lower_bound(tails.begin(), tails.end(), values[i], [&](int pos, int value)
+        {
+            return values[pos] < value;
+        });
+
+        const int length = it - tails.begin();
+        if (length > 0)
+            previous[i] = tails[length - 1];
+
+        if (it == tails.end())
+            tails.push_back(i);
+        else
+            *it = i;
+    }
+
+    QVector<bool> r(values.size(), false);
+    for (int i = tails.isEmpty() ? -1 : tails.back(); i != -1; i = previous[i])
+        r[i] = true;
+
+    return r;
+}
+
+QString formatSize(const QLocale &l, qint64 size) {
     return l.formattedDataSize(size);
 }
 
 
-QString formatDateTime(const QDateTime &t)
+QString formatDateTime(const QLocale &l, qint64 msecs)
 {
-    if (!t.isValid() || t.toMSecsSinceEpoch() == 0) return {};
+    if (msecs == 0) return {};
 
-    const auto l = QLocale::system();
-    return l.toString(t);
+    return l.toString(QDateTime::fromMSecsSinceEpoch(msecs));
 }
 
 }
@@ -41,7 +88,34 @@ public:
 
     auto db() const { return m_db; }
 
-    void clear() { m_data.clear(); m_seenCount.reset(); m_parentSeen.reset(); }
+    void clear()
+    {
+        m_data.clear();
+        m_dirs.clear();
+        m_reading.clear();
+        m_seenCount = 0;
+        m_summary = {};
+        m_parentSeen.reset();
+        m_writtenSummary.reset();
+        ++m_generation;
+    }
+
+    // entry is no longer in directory
+    void forget(const QString &mrl)
+    {
+        auto itr = m_data.find(mrl);
+        if (itr != m_data.end())
+        {
+            account(mrl, *itr, -1);
+            m_data.erase(itr);
+        }
+
+        m_dirs.remove(mrl);
+        m_reading.remove(mrl);
+    }
+
+    // entries of directory changed, aggregates may now be complete
+    void updateAggregates() { onFileSeen({}, {}); }
 
 #define DBHandler_IMPL(TYPE, MEMBER, SETTER, ROLE, DEFAULT) \
     TYPE MEMBER(QPersistentModelIndex idx, const QString &mrl) \
@@ -57,8 +131,9 @@ public:
     { \
         m_db->SETTER(mrl, value); \
         QList<int> r{ROLE, DirectorySystemModel::ShowNewIndicatorRole}; \
-        if (ROLE == DirectorySystemModel::SeenRole && (value != m_data[mrl].MEMBER)) updateSeen(value); \
-        m_data[mrl].MEMBER = value; \
+        auto data = m_data.value(mrl); \
+        data.MEMBER = value; \
+        store(mrl, data); \
         handleUpdate(idx, r); \
     }
 
@@ -85,18 +160,135 @@ public:
                 && (itr->progress.value_or(0.0) < 0.02);
     }
 
+    // reads history of @mrls with one query instead of one per row as they are shown,
+    // rows are notified once, when all of it is available, @dirs tells which are directories
+    void prefetch(const QStringList &mrls, const QList<bool> &dirs)
+    {
+        QStringList pending;
+        pending.reserve(mrls.size());
+        for (int i = 0; i < mrls.size(); ++i)
+        {
+            const auto &mrl = mrls[i];
+            setDir(mrl, dirs[i]);
+
+            if (m_data.contains(mrl) || m_reading.contains(mrl))
+                continue;
+
+            m_reading.insert(mrl);
+            pending.push_back(mrl);
+        }
+
+        if (pending.isEmpty())
+            return;
+
+        const auto generation = m_generation;
+        m_db->readBatch(pending).then(m_parent, [this, pending, generation](const FileHistoryDB::DataMap &found)
+        {
+            // directory was replaced meanwhile, or history was rewritten by apply()
+            if (generation != m_generation)
+                return;
+
+            for (const auto &mrl : pending)
+            {
+                // forgotten, entry is no longer shown
+                if (!m_reading.remove(mrl))
+                    continue;
+
+                store(mrl, found.value(mrl));
+            }
+
+            m_parent->historyChanged({DirectorySystemModel::SeenRole
+                                      , DirectorySystemModel::ProgressRole
+                                      , DirectorySystemModel::PreviewedRole
+                                      , DirectorySystemModel::ShowNewIndicatorRole});
+
+            onFileSeen({}, {});
+        });
+    }
+
+    // @mrls are updated in memory right away, history of those which weren't known yet is
+    // read again once db is done, reads in flight predate the operation so they're dropped
+    void apply(FileHistoryDB::BulkOperation operation, const QStringList &mrls, const QString &tree)
+    {
+        auto reread = m_reading.values();
+        m_reading.clear();
+        ++m_generation;
+
+        for (const auto &mrl : mrls)
+        {
+            auto itr = m_data.constFind(mrl);
+            if (itr == m_data.constEnd())
+                reread.push_back(mrl);
+
+            auto data = itr != m_data.constEnd() ? *itr : FileHistoryDB::Data {};
+            switch (operation)
+            {
+            case FileHistoryDB::BulkOperation::MarkSeen:
+                data.seen = true;
+                break;
+            case FileHistoryDB::BulkOperation::MarkUnseen:
+                data.seen = false;
+                break;
+            case FileHistoryDB::BulkOperation::ResetProgress:
+                data.progress = 0;
+                break;
+            }
+
+            store(mrl, data);
+        }
+
+        m_parent->historyChanged({DirectorySystemModel::SeenRole
+                                  , DirectorySystemModel::ProgressRole
+                                  , DirectorySystemModel::ShowNewIndicatorRole});
+
+        const auto generation = m_generation;
+        m_db->apply(operation, mrls, tree).then(m_parent, [this, reread, generation](qint64)
+        {
+            if (generation != m_generation || reread.isEmpty())
+                return;
+
+            for (const auto &mrl : reread)
+                m_reading.insert(mrl);
+
+            m_db->readBatch(reread).then(m_parent, [this, reread, generation](const FileHistoryDB::DataMap &found)
+            {
+                if (generation != m_generation)
+                    return;
+
+                for (const auto &mrl : reread)
+                {
+                    if (m_reading.remove(mrl))
+                        store(mrl, found.value(mrl));
+                }
+
+                m_parent->historyChanged({DirectorySystemModel::SeenRole
+                                          , DirectorySystemModel::ProgressRole
+                                          , DirectorySystemModel::PreviewedRole
+                                          , DirectorySystemModel::ShowNewIndicatorRole});
+
+                onFileSeen({}, {});
+            });
+        });
+
+        onFileSeen({}, {});
+    }
+
 private:
     void read(const QPersistentModelIndex &idx, const QString &mrl)
     {
         if (m_reading.contains(mrl)) return;
 
         m_reading.insert(mrl);
-        m_db->read(mrl).then(m_parent, [this, mrl, idx](const FileHistoryDB::Data &data)
+
+        const auto generation = m_generation;
+        m_db->read(mrl).then(m_parent, [this, mrl, idx, generation](const FileHistoryDB::Data &data)
         {
+            if (generation != m_generation) return;
+
             m_reading.remove(mrl);
             if (!idx.isValid()) return;
 
-            m_data[mrl] = data;
+            store(mrl, data);
 
             // only notify if something was changed, QML views doesn't like us otherwise
             QList<int> changed({DirectorySystemModel::ShowNewIndicatorRole});
@@ -117,16 +309,70 @@ private:
         });
     }
 
+    // adds (@sign = 1) or removes (@sign = -1) @data of @mrl from aggregates, these are
+    // only touched when an entry changes, so keeping them is O(1) per update
+    void account(const QString &mrl, const FileHistoryDB::Data &data, int sign)
+    {
+        const bool seen = data.seen.value_or(false);
+        if (seen)
+            m_seenCount += sign;
+
+        // summary only covers files, sub directories are summarized on their own
+        if (m_dirs.contains(mrl))
+            return;
+
+        m_summary.files += sign;
+        m_summary.seen += seen ? sign : 0;
+        m_summary.previewed += data.previewed.value_or(false) ? sign : 0;
+        m_summary.progress += sign * data.progress.value_or(0.0);
+    }
+
+    void store(const QString &mrl, const FileHistoryDB::Data &data)
+    {
+        auto itr = m_data.find(mrl);
+        if (itr != m_data.end())
+        {
+            account(mrl, *itr, -1);
+            *itr = data;
+        }
+        else
+        {
+            m_data.insert(mrl, data);
+        }
+
+        account(mrl, data, 1);
+    }
+
+    void setDir(const QString &mrl, bool dir)
+    {
+        if (m_dirs.contains(mrl) == dir)
+            return;
+
+        auto itr = m_data.find(mrl);
+        if (itr != m_data.end())
+            account(mrl, *itr, -1);
+
+        if (dir)
+            m_dirs.insert(mrl);
+        else
+            m_dirs.remove(mrl);
+
+        if (itr != m_data.end())
+            account(mrl, *itr, 1);
+    }
+
     void onFileSeen(QPersistentModelIndex idx, QList<int> role)
     {
-        const auto fileCount = m_parent->directory()->fileCount();
+        // aggregate is meaningless till all entries are known
+        if (!m_parent->isDirectoryComplete())
+            return;
+
+        const auto fileCount = m_parent->rowCount();
         const bool dataForAllAvailable = (m_data.size() == fileCount);
         if (dataForAllAvailable)
         {
-            m_seenCount = std::count_if(m_data.begin(), m_data.end()
-                                        , [](auto d) { return d.seen; });
-
             updateParentSeen();
+            updateSummary();
         }
     }
 
@@ -137,27 +383,11 @@ private:
         onFileSeen(idx, role);
     }
 
-    // should only be called when data is changed
-    void updateSeen(bool seen)
-    {
-        if (!m_seenCount.has_value())
-            return;
-
-        if (seen)
-            ++m_seenCount.value();
-        else
-            --m_seenCount.value();
-
-        updateParentSeen();
-    }
-
-    // should only be called when data is changed
+    // only writes on transitions
     void updateParentSeen()
     {
-        assert(m_seenCount.has_value());
-
         auto dir = m_parent->directory();
-        const bool seen = (m_seenCount == dir->fileCount());
+        const bool seen = (m_seenCount == m_parent->rowCount());
 
         if (!m_parentSeen.has_value() || m_parentSeen != seen)
         {
@@ -168,30 +398,600 @@ private:
         }
     }
 
+    // rolled up into ancestors by the db, so folders can be badged without opening them
+    void updateSummary()
+    {
+        if (m_writtenSummary == m_summary)
+            return;
+
+        m_writtenSummary = m_summary;
+        m_db->setFolderSummary(m_parent->directory()->path(), m_summary);
+    }
+
     DirectorySystemModel *m_parent;
     std::shared_ptr<FileHistoryDB> m_db;
     UpdateCB m_cb;
     QHash<QString, FileHistoryDB::Data> m_data;
+    QSet<QString> m_dirs;
     QSet<QString> m_reading;
 
-    std::optional<std::intmax_t> m_seenCount;
+    // bumped on clear(), batches read for a previous directory are dropped
+    int m_generation = 0;
+
+    // over entries in m_data
+    std::intmax_t m_seenCount = 0;
+    FileHistoryDB::FolderSummary m_summary;
+
+    // last written to db
     std::optional<bool> m_parentSeen;
+    std::optional<FileHistoryDB::FolderSummary> m_writtenSummary;
 };
 
 DirectorySystemModel::DirectorySystemModel(QObject *parent)
     : QAbstractTableModel{parent}
+    , m_locale {QLocale::system()}
+{
+    // system locale changes are only announced to the application
+    if (auto app = QCoreApplication::instance())
+        app->installEventFilter(this);
+}
+
+DirectorySystemModel::~DirectorySystemModel()
 {
+    watchProgress(m_dir.get(), false);
+    watchChanges(m_dir.get(), false);
 }
 
-void DirectorySystemModel::setDirectory(std::shared_ptr<Directory> dir)
+bool DirectorySystemModel::setDirectory(std::shared_ptr<Directory> dir)
 {
-    beginResetModel();
+    watchProgress(m_dir.get(), false);
+    watchChanges(m_dir.get(), false);
+
+    m_locale = QLocale::system();
+    invalidateDisplay();
+
+    const bool inPlace = canUpdateInPlace(dir.get());
+    if (inPlace)
+    {
+        flushDataChanged();
+        updateDirectory(std::move(dir));
+    }
+    else
+    {
+        m_pendingChanges.clear();
+        beginResetModel();
+
+        m_dir = dir;
+        m_rowCount = m_dir ? m_dir->fileCount() : 0;
+        m_columns.clear();
+        appendColumns(0, m_rowCount);
+        if (m_dbHandler)
+            m_dbHandler->clear();
+
+        prefetchHistory(0, m_rowCount);
+
+        endResetModel();
+    }
+
+    watchProgress(m_dir.get(), true);
+    watchChanges(m_dir.get(), true);
+
+    return inPlace;
+}
+
+// a new snapshot of the shown directory (refresh, reopen), a reset would make the
+// sort model and views start over
+bool DirectorySystemModel::canUpdateInPlace(Directory *dir) const
+{
+    if (!m_dir || !dir || m_dir->url() != dir->url())
+        return false;
+
+    // rows still to be loaded would be removed and inserted again
+    auto incremental = dynamic_cast<IncrementalDirectory *>(dir);
+    return !incremental || incremental->isComplete();
+}
+
+/*
+ * rows are matched by path, those which are gone are removed, the rest are put in
+ * order of @dir and new ones are inserted in between, rows are mapped to indexes
+ * of the directory through m_rowMap till they are in the same order
+ */
+void DirectorySystemModel::updateDirectory(std::shared_ptr<Directory> dir)
+{
+    const int count = dir->fileCount();
+
+    DirectoryColumns columns;
+    dir->fill(0, count, DirectoryColumns::AllFields, columns);
+
+    QHash<QString, int> indexes;
+    indexes.reserve(count);
+    for (int i = 0; i < count; ++i)
+        indexes.insert(columns.paths[i], i);
+
+    // index of each row in new directory, -1 if it's gone
+    QVector<int> target(m_rowCount);
+    for (int row = 0; row < m_rowCount; ++row)
+        target[row] = indexes.value(m_columns.paths[row], -1);
+
+    m_rowMap.resize(m_rowCount);
+    std::iota(m_rowMap.begin(), m_rowMap.end(), 0);
+
+    for (int last = m_rowCount - 1; last >= 0;)
+    {
+        if (target[last] != -1)
+        {
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && target[first - 1] == -1)
+            --first;
+
+        beginRemoveRows(QModelIndex(), first, last);
+
+        if (m_dbHandler)
+        {
+            for (int row = first; row <= last; ++row)
+                m_dbHandler->forget(m_columns.paths[m_rowMap[row]]);
+        }
+
+        const int removed = last - first + 1;
+        m_rowMap.remove(first, removed);
+        target.remove(first, removed);
+        m_rowCount -= removed;
+
+        endRemoveRows();
+        last = first - 1;
+    }
+
+    QVector<bool> changed(count, false);
+    for (int row = 0; row < m_rowCount; ++row)
+        changed[target[row]] = !sameEntry(m_columns, m_rowMap[row], columns, target[row]);
+
+    // remaining rows refer to same entries in the new directory
+    m_dir = std::move(dir);
+    m_columns = std::move(columns);
+    m_rowMap = std::move(target);
+    invalidateDisplay();
+
+    // only new entries are read
+    prefetchHistory(0, count);
+
+    reorderRows();
+
+    // rows are now a sorted subset of indexes, fill the gaps
+    for (int row = 0; row < count;)
+    {
+        const int next = row < m_rowMap.size() ? m_rowMap[row] : count;
+        if (next == row)
+        {
+            ++row;
+            continue;
+        }
+
+        beginInsertRows(QModelIndex(), row, next - 1);
+
+        QVector<int> inserted(next - row);
+        std::iota(inserted.begin(), inserted.end(), row);
+        m_rowMap.insert(row, inserted.size(), 0);
+        std::copy(inserted.begin(), inserted.end(), m_rowMap.begin() + row);
+        m_rowCount += inserted.size();
+
+        endInsertRows();
+        row = next;
+    }
+
+    m_rowMap.clear();
+
+    for (int first = 0; first < count;)
+    {
+        if (!changed[first])
+        {
+            ++first;
+            continue;
+        }
+
+        int last = first;
+        while (last + 1 < count && changed[last + 1])
+            ++last;
+
+        emit dataChanged(index(first, 0), index(last, ColumnCount - 1));
+        first = last + 1;
+    }
 
-    m_dir = dir;
     if (m_dbHandler)
-        m_dbHandler->clear();
+        m_dbHandler->updateAggregates();
+}
+
+// sorts m_rowMap, rows which are out of order are moved
+void DirectorySystemModel::reorderRows()
+{
+    if (std::is_sorted(m_rowMap.begin(), m_rowMap.end()))
+        return;
+
+    QVector<bool> stable = increasingSubsequence(m_rowMap);
+    const int moves = std::count(stable.begin(), stable.end(), false);
+
+    if (moves > MAX_ROW_MOVES)
+    {
+        emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+        // values are distinct, so the new row of a row is its rank
+        QVector<int> rows(m_rowMap.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        std::sort(rows.begin(), rows.end(), [this](int l, int r) { return m_rowMap[l] < m_rowMap[r]; });
+
+        QVector<int> newRow(rows.size());
+        for (int i = 0; i < rows.size(); ++i)
+            newRow[rows[i]] = i;
+
+        const auto from = persistentIndexList();
+        QModelIndexList to;
+        to.reserve(from.size());
+        for (const auto &idx : from)
+            to.push_back(index(newRow[idx.row()], idx.column()));
+
+        changePersistentIndexList(from, to);
+        std::sort(m_rowMap.begin(), m_rowMap.end());
+
+        emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+        return;
+    }
+
+    for (int row = 0; row < m_rowMap.size(); ++row)
+    {
+        if (stable[row])
+            continue;
+
+        // goes right before the first stable row which comes after it
+        const int value = m_rowMap[row];
+        int destination = m_rowMap.size();
+        for (int i = 0; i < m_rowMap.size(); ++i)
+        {
+            if (stable[i] && m_rowMap[i] > value)
+            {
+                destination = i;
+                break;
+            }
+        }
+
+        if (destination != row && destination != row + 1)
+        {
+            beginMoveRows(QModelIndex(), row, row, QModelIndex(), destination);
+
+            const int to = destination > row ? destination - 1 : destination;
+            m_rowMap.move(row, to);
+            stable.move(row, to);
+
+            endMoveRows();
+        }
+
+        stable[destination > row ? destination - 1 : destination] = true;
+
+        // rows after this one shifted, start over
+        row = -1;
+    }
+}
+
+// entries of an incremental directory are inserted in batches as they are loaded
+void DirectorySystemModel::watchProgress(Directory *dir, bool watch)
+{
+    auto incremental = dynamic_cast<IncrementalDirectory *>(dir);
+    if (!incremental)
+        return;
+
+    if (!watch)
+    {
+        incremental->setProgressCallback(nullptr);
+        return;
+    }
+
+    if (incremental->isComplete() && m_rowCount == dir->fileCount())
+        return;
+
+    incremental->setProgressCallback([this]()
+    {
+        // called from loading thread, keep at most one insertion queued
+        if (m_insertPending.exchange(true))
+            return;
+
+        QMetaObject::invokeMethod(this, &DirectorySystemModel::insertLoadedRows, Qt::QueuedConnection);
+    });
+
+    // entries may have been added before the callback was set
+    insertLoadedRows();
+}
+
+void DirectorySystemModel::insertLoadedRows()
+{
+    m_insertPending = false;
+    if (!m_dir)
+        return;
+
+    const int count = m_dir->fileCount();
+    if (count <= m_rowCount)
+        return;
+
+    appendColumns(m_rowCount, count - m_rowCount);
+    invalidateDisplay(m_rowCount);
+    prefetchHistory(m_rowCount, count - m_rowCount);
+
+    beginInsertRows(QModelIndex(), m_rowCount, count - 1);
+    m_rowCount = count;
+    endInsertRows();
+}
+
+void DirectorySystemModel::watchChanges(Directory *dir, bool watch)
+{
+    auto watched = dynamic_cast<WatchedDirectory *>(dir);
+    if (!watched)
+        return;
+
+    if (!watch)
+    {
+        watched->setChangeCallback(nullptr);
+        return;
+    }
+
+    watched->setChangeCallback([this]()
+    {
+        // called from watching thread, keep at most one application queued
+        if (m_changesPending.exchange(true))
+            return;
+
+        QMetaObject::invokeMethod(this, &DirectorySystemModel::applyDirectoryChanges, Qt::QueuedConnection);
+    });
+}
+
+// changes on disk are applied as row insertions and removals, no reset
+void DirectorySystemModel::applyDirectoryChanges()
+{
+    m_changesPending = false;
+
+    auto watched = dynamic_cast<WatchedDirectory *>(m_dir.get());
+    if (!watched)
+        return;
+
+    // pending rows are numbered before these changes
+    flushDataChanged();
+
+    // changes refer to rows of the directory, entries still being loaded come first
+    insertLoadedRows();
+
+    const auto before = [this](const DirectoryChange &change)
+    {
+        switch (change.type)
+        {
+        case DirectoryChange::Inserted:
+            beginInsertRows(QModelIndex(), change.first, change.last);
+            break;
+        case DirectoryChange::Removed:
+            if (m_dbHandler)
+            {
+                for (int row = change.first; row <= change.last; ++row)
+                    m_dbHandler->forget(m_columns.paths[row]);
+            }
+
+            beginRemoveRows(QModelIndex(), change.first, change.last);
+            break;
+        case DirectoryChange::Updated:
+            break;
+        }
+    };
+
+    const auto after = [this](const DirectoryChange &change)
+    {
+        const int count = change.last - change.first + 1;
+        switch (change.type)
+        {
+        case DirectoryChange::Inserted:
+            appendColumns(change.first, count);
+            invalidateDisplay(change.first);
+            prefetchHistory(change.first, count);
+            m_rowCount += count;
+            endInsertRows();
+            break;
+        case DirectoryChange::Removed:
+            m_columns.remove(change.first, count);
+            invalidateDisplay(change.first);
+            m_rowCount -= count;
+            endRemoveRows();
+            break;
+        case DirectoryChange::Updated:
+            refreshColumns(change.first, count);
+            invalidateDisplay(change.first);
+            emit dataChanged(index(change.first, 0), index(change.last, ColumnCount - 1));
+            break;
+        }
+
+        if (m_dbHandler)
+            m_dbHandler->updateAggregates();
+    };
+
+    watched->applyChanges(before, after);
+}
+
+void DirectorySystemModel::appendColumns(int first, int count)
+{
+    if (m_dir && count > 0)
+        m_dir->fill(first, count, DirectoryColumns::AllFields, m_columns);
+}
+
+void DirectorySystemModel::refreshColumns(int first, int count)
+{
+    DirectoryColumns updated;
+    m_dir->fill(first, count, DirectoryColumns::AllFields, updated);
+
+    std::copy(updated.names.begin(), updated.names.end(), m_columns.names.begin() + first);
+    std::copy(updated.paths.begin(), updated.paths.end(), m_columns.paths.begin() + first);
+    std::copy(updated.sizes.begin(), updated.sizes.end(), m_columns.sizes.begin() + first);
+    std::copy(updated.dirs.begin(), updated.dirs.end(), m_columns.dirs.begin() + first);
+    std::copy(updated.lastAccessTimes.begin(), updated.lastAccessTimes.end(), m_columns.lastAccessTimes.begin() + first);
+    std::copy(updated.creationTimes.begin(), updated.creationTimes.end(), m_columns.creationTimes.begin() + first);
+    std::copy(updated.modifiedTimes.begin(), updated.modifiedTimes.end(), m_columns.modifiedTimes.begin() + first);
+}
+
+void DirectorySystemModel::prefetchHistory(int first, int count)
+{
+    if (!m_dbHandler || count <= 0)
+        return;
+
+    m_dbHandler->prefetch(m_columns.paths.mid(first, count), m_columns.dirs.mid(first, count));
+}
+
+// one notification for all rows, views only refresh the visible ones
+void DirectorySystemModel::historyChanged(const QList<int> &roles)
+{
+    if (m_rowCount > 0)
+        queueDataChanged(0, m_rowCount - 1, roles);
+}
+
+// history results and setters change rows one at a time, views re-evaluate delegates
+// for every dataChanged(), so rows are collected and reported once per event loop tick
+void DirectorySystemModel::queueDataChanged(int first, int last, const QList<int> &roles)
+{
+    if (first < 0)
+        return;
 
-    endResetModel();
+    m_pendingChanges.push_back({first, last, roles});
+    if (m_flushQueued)
+        return;
+
+    m_flushQueued = true;
+    QMetaObject::invokeMethod(this, &DirectorySystemModel::flushDataChanged, Qt::QueuedConnection);
+}
+
+// overlapping and adjacent rows are merged, with union of their roles
+void DirectorySystemModel::flushDataChanged()
+{
+    m_flushQueued = false;
+    if (m_pendingChanges.isEmpty())
+        return;
+
+    auto pending = std::move(m_pendingChanges);
+    m_pendingChanges.clear();
+
+    std::sort(pending.begin(), pending.end(), [](const PendingChange &l, const PendingChange &r)
+    {
+        return l.first < r.first;
+    });
+
+    const auto report = [this](const PendingChange &change)
+    {
+        const int last = std::min(change.last, m_rowCount - 1);
+        if (change.first <= last)
+            emit dataChanged(index(change.first, 0), index(last, ColumnCount - 1), change.roles);
+    };
+
+    PendingChange current = pending.front();
+    for (int i = 1; i < pending.size(); ++i)
+    {
+        const auto &next = pending[i];
+        if (next.first > current.last + 1)
+        {
+            report(current);
+            current = next;
+            continue;
+        }
+
+        current.last = std::max(current.last, next.last);
+
+        if (current.roles.isEmpty() || next.roles.isEmpty())
+        {
+            current.roles.clear();
+            continue;
+        }
+
+        for (int role : next.roles)
+        {
+            if (!current.roles.contains(role))
+                current.roles.push_back(role);
+        }
+    }
+
+    report(current);
+}
+
+QString DirectorySystemModel::displayString(int index, int column) const
+{
+    auto &batches = m_displayBatches[column];
+    auto &strings = m_display[column];
+
+    const int batch = index / DISPLAY_BATCH;
+    if (batch >= batches.size())
+        batches.resize(batch + 1, false);
+
+    if (!batches[batch])
+    {
+        const int first = batch * DISPLAY_BATCH;
+        const int last = std::min<int>(first + DISPLAY_BATCH, m_columns.names.size());
+        if (strings.size() < last)
+            strings.resize(last);
+
+        for (int i = first; i < last; ++i)
+            strings[i] = formatDisplay(i, column);
+
+        batches[batch] = true;
+    }
+
+    return strings[index];
+}
+
+QString DirectorySystemModel::formatDisplay(int index, int column) const
+{
+    switch (column)
+    {
+    case PathColumn:
+        return QDir::toNativeSeparators(m_columns.paths[index]);
+    case SizeColumn:
+        if (m_columns.dirs[index] && m_columns.sizes[index] == 0)
+            return QString {};
+
+        return formatSize(m_locale, m_columns.sizes[index]);
+    case LastAccessTimeColumn:
+        return formatDateTime(m_locale, m_columns.lastAccessTimes[index]);
+    case ModifedTimeColumn:
+        return formatDateTime(m_locale, m_columns.modifiedTimes[index]);
+    case CreationTimeColumn:
+        return formatDateTime(m_locale, m_columns.creationTimes[index]);
+    }
+
+    return {};
+}
+
+// entries from @first on are formatted again when next shown
+void DirectorySystemModel::invalidateDisplay(int first)
+{
+    const int batch = first / DISPLAY_BATCH;
+    for (int c = 0; c < ColumnCount; ++c)
+    {
+        if (m_displayBatches[c].size() > batch)
+            m_displayBatches[c].resize(batch);
+
+        if (m_display[c].size() > batch * DISPLAY_BATCH)
+            m_display[c].resize(batch * DISPLAY_BATCH);
+    }
+}
+
+bool DirectorySystemModel::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::LocaleChange && watched == QCoreApplication::instance())
+    {
+        m_locale = QLocale::system();
+        invalidateDisplay();
+
+        if (m_rowCount > 0)
+            queueDataChanged(0, m_rowCount - 1, {Qt::DisplayRole});
+    }
+
+    return QAbstractTableModel::eventFilter(watched, event);
+}
+
+bool DirectorySystemModel::isDirectoryComplete() const
+{
+    auto incremental = dynamic_cast<IncrementalDirectory *>(m_dir.get());
+    return !incremental || (incremental->isComplete() && m_rowCount == m_dir->fileCount());
 }
 
 std::shared_ptr<Directory> DirectorySystemModel::directory()
@@ -199,14 +999,14 @@ std::shared_ptr<Directory> DirectorySystemModel::directory()
     return m_dir;
 }
 
-int DirectorySystemModel::rowCount(const QModelIndex &) const
+int DirectorySystemModel::rowCount(const QModelIndex &parent) const
 {
-    return m_dir ? m_dir->fileCount() : 0;
+    return parent.isValid() ? 0 : m_rowCount;
 }
 
 int DirectorySystemModel::columnCount(const QModelIndex &parent) const
 {
-    return ColumnCount;
+    return parent.isValid() ? 0 : ColumnCount;
 }
 
 QVariant DirectorySystemModel::data(const QModelIndex &index, int role) const
@@ -215,32 +1015,22 @@ QVariant DirectorySystemModel::data(const QModelIndex &index, int role) const
         return {};
 
 
-    const int r = index.row();
+    const int r = directoryIndex(index.row());
     const int c = index.column();
+    const auto &columns = m_columns;
 
     const auto displayRole = [&]() -> QString
     {
         switch (c)
         {
         case NameColumn:
-            return m_dir->fileName(r);
+            return columns.names[r];
         case PathColumn:
-            if (role == Qt::DisplayRole)
-                return QDir::toNativeSeparators(m_dir->filePath(r));
-
-            return m_dir->filePath(r);
         case SizeColumn:
-            if (m_dir->isDir(r) && m_dir->fileSize(r) == 0)
-                return QString {};
-
-            return formatSize(m_dir->fileSize(r));
-
         case LastAccessTimeColumn:
-            return formatDateTime(m_dir->fileLastAccessTime(r));
         case ModifedTimeColumn:
-            return formatDateTime(m_dir->fileModifiedTime(r));
         case CreationTimeColumn:
-            return formatDateTime(m_dir->fileCreationTime(r));
+            return displayString(r, c);
         }
 
         return "";
@@ -251,17 +1041,17 @@ QVariant DirectorySystemModel::data(const QModelIndex &index, int role) const
         switch (c)
         {
         case NameColumn:
-            return m_dir->fileName(r);
+            return columns.names[r];
         case PathColumn:
-            return m_dir->filePath(r);
+            return columns.paths[r];
         case SizeColumn:
-            return m_dir->fileSize(r);
+            return columns.sizes[r];
         case LastAccessTimeColumn:
-            return m_dir->fileLastAccessTime(r);
+            return DirectoryColumns::fromMSecs(columns.lastAccessTimes[r]);
         case ModifedTimeColumn:
-            return m_dir->fileModifiedTime(r);
+            return DirectoryColumns::fromMSecs(columns.modifiedTimes[r]);
         case CreationTimeColumn:
-            return m_dir->fileCreationTime(r);
+            return DirectoryColumns::fromMSecs(columns.creationTimes[r]);
         }
 
         return {};
@@ -278,32 +1068,32 @@ QVariant DirectorySystemModel::data(const QModelIndex &index, int role) const
     case DataRole:
         return sortRole();
     case NameRole:
-        return m_dir->fileName(r);
+        return columns.names[r];
     case PathRole:
-        return m_dir->filePath(r);
+        return columns.paths[r];
     case SizeRole:
-        return m_dir->fileSize(r);
+        return columns.sizes[r];
     case IsDirRole:
-        return m_dir->isDir(r);
+        return columns.dirs[r];
     case SeenRole:
     case ProgressRole:
     case PreviewedRole:
     case ShowNewIndicatorRole:
     {
-        if (m_dir->isDir(r)
+        if (columns.dirs[r]
             && (role != SeenRole))
             return {};
 
         switch (role)
         {
         case SeenRole:
-            return m_dbHandler->seen(QPersistentModelIndex(index), m_dir->filePath(r));
+            return m_dbHandler->seen(QPersistentModelIndex(index), columns.paths[r]);
         case ProgressRole:
-            return m_dbHandler->progress(QPersistentModelIndex(index), m_dir->filePath(r));
+            return m_dbHandler->progress(QPersistentModelIndex(index), columns.paths[r]);
         case PreviewedRole:
-            return m_dbHandler->previewed(QPersistentModelIndex(index), m_dir->filePath(r));
+            return m_dbHandler->previewed(QPersistentModelIndex(index), columns.paths[r]);
         case ShowNewIndicatorRole:
-            return m_dbHandler->showNewIndicator(QPersistentModelIndex(index), m_dir->filePath(r));
+            return m_dbHandler->showNewIndicator(QPersistentModelIndex(index), columns.paths[r]);
         }
     }
     }
@@ -316,17 +1106,19 @@ bool DirectorySystemModel::setData(const QModelIndex &index, const QVariant &val
     if (!m_dbHandler || !checkIndex(index, QAbstractItemModel::CheckIndexOption::IndexIsValid))
         return false;
 
-    const int r = index.row();
+    const int r = directoryIndex(index.row());
     qDebug() << "setData" << index.data(PathRole) << (Roles)role << value;
-    if (m_dir->isDir(r))
+    if (m_columns.dirs[r])
         return false;
 
+    const QString path = m_columns.paths[r];
+
     if (role == SeenRole)
     {
         if (value.metaType() != QMetaType(QMetaType::Bool))
             return false;
 
-        m_dbHandler->setSeen(index, m_dir->filePath(r), value.toBool());
+        m_dbHandler->setSeen(index, path, value.toBool());
     }
     else if (role == ProgressRole)
     {
@@ -335,14 +1127,14 @@ bool DirectorySystemModel::setData(const QModelIndex &index, const QVariant &val
         if (!ok)
             return false;
 
-        m_dbHandler->setProgress(index, m_dir->filePath(r), progress);
+        m_dbHandler->setProgress(index, path, progress);
     }
     else if (role == PreviewedRole)
     {
         if (value.metaType() != QMetaType(QMetaType::Bool))
             return false;
 
-        m_dbHandler->setPreviewed(index, m_dir->filePath(r), value.toBool());
+        m_dbHandler->setPreviewed(index, path, value.toBool());
     }
 
     return false;
@@ -397,11 +1189,58 @@ void DirectorySystemModel::setFileHistoryDB(const std::shared_ptr<FileHistoryDB>
 {
     const auto updateHandler = [this](const QPersistentModelIndex &idx, QList<int> role)
     {
-        emit dataChanged(index(idx.row(), 0)
-                         , index(idx.row(), ColumnCount - 1), role);
+        queueDataChanged(idx.row(), idx.row(), role);
     };
 
     m_dbHandler.reset(new DBHandler(this, newHistoryDB, updateHandler));
+    prefetchHistory(0, m_columns.names.size());
+}
+
+void DirectorySystemModel::applyHistory(FileHistoryDB::BulkOperation operation, const QList<int> &rows)
+{
+    if (!m_dbHandler)
+        return;
+
+    QStringList mrls;
+    const auto add = [&](int row)
+    {
+        const int r = directoryIndex(row);
+        if (!m_columns.dirs[r])
+            mrls.push_back(m_columns.paths[r]);
+    };
+
+    if (rows.isEmpty())
+    {
+        mrls.reserve(m_rowCount);
+        for (int row = 0; row < m_rowCount; ++row)
+            add(row);
+    }
+    else
+    {
+        mrls.reserve(rows.size());
+        for (const int row : rows)
+        {
+            if (row >= 0 && row < m_rowCount)
+                add(row);
+        }
+    }
+
+    if (!mrls.isEmpty())
+        m_dbHandler->apply(operation, mrls, {});
+}
+
+void DirectorySystemModel::applyHistoryRecursively(FileHistoryDB::BulkOperation operation)
+{
+    if (!m_dbHandler || !m_dir)
+        return;
+
+    // folders are entries too, db reaches those with history, shown ones are updated here
+    QStringList mrls;
+    mrls.reserve(m_rowCount);
+    for (int row = 0; row < m_rowCount; ++row)
+        mrls.push_back(m_columns.paths[directoryIndex(row)]);
+
+    m_dbHandler->apply(operation, mrls, m_dir->path());
 }
 
 void DirectorySystemModel::setIconProvider(const IconProviderFunctor &newIconProvider)
@@ -2,10 +2,13 @@
 #define DIRECTORYSYSTEMMODEL_HPP
 
 #include <QAbstractListModel>
+#include <QLocale>
+#include <atomic>
 #include <memory>
 
-class Directory;
-class FileHistoryDB;
+#include "directorysystem.hpp"
+#include "filehistorydb.hpp"
+
 
 class DirectorySystemModel : public QAbstractTableModel
 {
@@ -44,8 +47,11 @@ public:
     };
 
     explicit DirectorySystemModel(QObject *parent = nullptr);
+    ~DirectorySystemModel();
 
-    void setDirectory(std::shared_ptr<Directory> dir);
+    // returns true if rows of same directory were updated in place, persistent indexes
+    // then still refer to the same entries
+    bool setDirectory(std::shared_ptr<Directory> dir);
     std::shared_ptr<Directory> directory();
 
     void setIconProvider(const IconProviderFunctor &newIconProvider);
@@ -64,10 +70,76 @@ public:
     std::shared_ptr<FileHistoryDB> fileHistoryDB() const;
     void setFileHistoryDB(const std::shared_ptr<FileHistoryDB> &newHistoryDB);
 
+    // applies @operation to files of @rows, or of every row if @rows is empty, with one write
+    // to db and one dataChanged()
+    void applyHistory(FileHistoryDB::BulkOperation operation, const QList<int> &rows = {});
+
+    // like applyHistory() for every row, and for all history below directory, folders
+    // below aren't opened, so files of them without history are left as they are
+    void applyHistoryRecursively(FileHistoryDB::BulkOperation operation);
+
+    // properties of exposed rows read from directory in bulk, indexed by directoryIndex(row),
+    // lets proxies compare rows without going through data()
+    const DirectoryColumns &columns() const { return m_columns; }
+    int directoryIndex(int row) const { return m_rowMap.isEmpty() ? row : m_rowMap[row]; }
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
 private:
     class DBHandler;
 
+    void watchProgress(Directory *dir, bool watch);
+    void insertLoadedRows();
+    void watchChanges(Directory *dir, bool watch);
+    void applyDirectoryChanges();
+
+    bool canUpdateInPlace(Directory *dir) const;
+    void updateDirectory(std::shared_ptr<Directory> dir);
+    void reorderRows();
+    bool isDirectoryComplete() const;
+
+    void appendColumns(int first, int count);
+    void prefetchHistory(int first, int count);
+    void historyChanged(const QList<int> &roles);
+
+    void queueDataChanged(int first, int last, const QList<int> &roles);
+    void flushDataChanged();
+    void refreshColumns(int first, int count);
+
+    QString displayString(int index, int column) const;
+    QString formatDisplay(int index, int column) const;
+    void invalidateDisplay(int first = 0);
+
     std::shared_ptr<Directory> m_dir;
+    DirectoryColumns m_columns;
+
+    // DisplayRole strings of formatted columns, indexed like m_columns, formatted a
+    // batch of entries at a time when first shown, m_displayBatches marks those done
+    mutable QStringList m_display[ColumnCount];
+    mutable QList<bool> m_displayBatches[ColumnCount];
+    QLocale m_locale;
+
+    // rows are inclusive, empty roles means all roles
+    struct PendingChange
+    {
+        int first;
+        int last;
+        QList<int> roles;
+    };
+
+    // dataChanged() to emit on next event loop iteration, flushed early before rows move
+    QList<PendingChange> m_pendingChanges;
+    bool m_flushQueued = false;
+
+    // rows exposed so far, an incremental directory may already have more entries
+    int m_rowCount = 0;
+    std::atomic<bool> m_insertPending {false};
+    std::atomic<bool> m_changesPending {false};
+
+    // row -> index in m_dir, only used while an in place update is in progress
+    QVector<int> m_rowMap;
+
     IconProviderFunctor m_iconProvider;
 
     mutable std::shared_ptr<DBHandler> m_dbHandler;
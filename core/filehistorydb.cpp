@@ -3,55 +3,111 @@
 
 #include <QSqlDatabase>
 #include <QMetaObject>
+#include <QTimer>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QDebug>
 
+#include <algorithm>
+#include <utility>
+
 #include "dbutil.hpp"
 
 namespace
 {
 
-template<typename Result>
+template<typename Result, typename Arg>
 QFuture<Result> invokeWorker(FileHistoryDBWorker *obj,
-                             void (FileHistoryDBWorker::*method)(QPromise<Result>&, const QString&),
-                             const QString &mrl)
+                             void (FileHistoryDBWorker::*method)(QPromise<Result>&, const Arg&),
+                             const Arg &arg)
 {
     QPromise<Result> promise;
     QFuture<Result> future = promise.future();
-    QMetaObject::invokeMethod(obj, [obj, promise = std::move(promise), mrl, method]() mutable
+    QMetaObject::invokeMethod(obj, [obj, promise = std::move(promise), arg, method]() mutable
     {
-        std::invoke(method, obj, std::ref(promise), mrl);
+        std::invoke(method, obj, std::ref(promise), arg);
     });
 
     return future;
 }
 
-template<typename T>
-void insert(std::unique_ptr<QSqlDatabase> &db
-        , const QString &col
-        , const QString &mrl, const T val)
+// version of layout below, stored in "PRAGMA user_version", 0 is the layout keyed by
+// full MRL in table files (and PATH in folders), it's migrated on open
+constexpr int SCHEMA_VERSION = 1;
+
+// parent directory of @path, null for top level ones
+QString parentPath(const QString &path)
 {
-    if (!db || !db->open())
-    {
-        qFatal("Database is not open");
-        return;
-    }
+    const auto separator = path.lastIndexOf('/');
+    if (separator < 0 || path == u"/")
+        return {};
 
-    QString stat = QString("INSERT INTO files (MRL, %1) VALUES (:mrl, :val)"
-                           "ON CONFLICT(MRL) DO UPDATE SET %1 = :val").arg(col);
-    QSqlQuery query(*db);
-    query.prepare(stat);
-    query.bindValue(":mrl", mrl);
-    query.bindValue(":val", val);
+    return separator == 0 ? QStringLiteral("/") : path.left(separator);
+}
 
-    if (!query.exec())
+// directory and basename of @mrl, directory is null if @mrl isn't a path
+std::pair<QString, QString> splitPath(const QString &mrl)
+{
+    const auto separator = mrl.lastIndexOf('/');
+    if (separator < 0)
+        return {QString {}, mrl};
+
+    return {separator == 0 ? QStringLiteral("/") : mrl.left(separator), mrl.mid(separator + 1)};
+}
+
+FileHistoryDB::FolderSummary summaryAt(QSqlQuery &query, int first)
+{
+    FileHistoryDB::FolderSummary summary;
+    summary.files = query.value(first).toLongLong();
+    summary.seen = query.value(first + 1).toLongLong();
+    summary.previewed = query.value(first + 2).toLongLong();
+    summary.progress = query.value(first + 3).toDouble();
+    return summary;
+}
+
+// column of entries written by @operation and value written
+std::pair<QString, QVariant> bulkColumn(FileHistoryDB::BulkOperation operation)
+{
+    switch (operation)
     {
-        qWarning("Failed to update '%s', mrl '%s' status: %s"
-                 , qUtf8Printable(col)
-                 , qUtf8Printable(mrl)
-                 , qUtf8Printable(query.lastError().text()));
+    case FileHistoryDB::BulkOperation::MarkSeen:
+        return {"SEEN", true};
+    case FileHistoryDB::BulkOperation::MarkUnseen:
+        return {"SEEN", false};
+    case FileHistoryDB::BulkOperation::ResetProgress:
+        return {"PROGRESS", 0.0};
     }
+
+    return {};
+}
+
+// directories at @path and below it, PATH is indexed so it's a range scan, @path's
+// descendants are between "@path/" and "@path0", '0' follows '/'
+QString subtreeCondition()
+{
+    return "(PATH = :path OR (PATH >= :first AND PATH < :last))";
+}
+
+void bindSubtree(QSqlQuery &query, const QString &path)
+{
+    const auto prefix = path.endsWith('/') ? path : path + '/';
+    query.bindValue(":path", path);
+    query.bindValue(":first", prefix);
+    query.bindValue(":last", prefix.chopped(1) + QChar('/' + 1));
+}
+
+// fields written in @pending replace those of @data
+void merge(const FileHistoryDB::Data &pending, FileHistoryDB::Data &data)
+{
+    if (pending.seen)
+        data.seen = pending.seen;
+    if (pending.progress)
+        data.progress = pending.progress;
+    if (pending.previewed)
+        data.previewed = pending.previewed;
 }
 
 }
@@ -64,13 +120,48 @@ FileHistoryDB::FileHistoryDB(const QString &source
 
     m_worker = new FileHistoryDBWorker;
     m_worker->moveToThread(&m_workerThread);
-    QMetaObject::invokeMethod(m_worker, "open"
-                              , Qt::AutoConnection
-                              , Q_ARG(QString, source));
+
+    QPromise<void> opened;
+    auto ready = opened.future();
+    QMetaObject::invokeMethod(m_worker, [worker = m_worker, source, opened = std::move(opened)]() mutable
+    {
+        opened.start();
+        worker->open(source);
+        opened.finish();
+    });
+
+    for (int i = 0; i < READERS; ++i)
+    {
+        m_readerThreads[i].start();
+
+        m_readers[i] = new FileHistoryDBReader(m_worker);
+        m_readers[i]->moveToThread(&m_readerThreads[i]);
+
+        // schema is created or migrated by writer, readers open after it
+        QMetaObject::invokeMethod(m_readers[i], [reader = m_readers[i], source, ready]() mutable
+        {
+            ready.waitForFinished();
+            reader->open(source);
+        });
+    }
 }
 
 FileHistoryDB::~FileHistoryDB()
 {
+    for (int i = 0; i < READERS; ++i)
+    {
+        QMetaObject::invokeMethod(m_readers[i], &FileHistoryDBReader::close, Qt::BlockingQueuedConnection);
+
+        m_readers[i]->deleteLater();
+        m_readers[i] = nullptr;
+
+        m_readerThreads[i].quit();
+        m_readerThreads[i].wait();
+    }
+
+    // pending writes must reach db before worker goes away
+    QMetaObject::invokeMethod(m_worker, &FileHistoryDBWorker::close, Qt::BlockingQueuedConnection);
+
     m_worker->deleteLater();
     m_worker = nullptr;
 
@@ -80,7 +171,93 @@ FileHistoryDB::~FileHistoryDB()
 
 QFuture<FileHistoryDB::Data> FileHistoryDB::read(const QString &mrl)
 {
-    return invokeWorker<Data>(m_worker, &FileHistoryDBWorker::read, mrl);
+    return invokeReader<Data>(&FileHistoryDBReader::read, mrl);
+}
+
+QFuture<FileHistoryDB::DataMap> FileHistoryDB::readBatch(const QStringList &mrls)
+{
+    return invokeReader<DataMap>(&FileHistoryDBReader::readBatch, mrls);
+}
+
+FileHistoryDB::ReadMetrics FileHistoryDB::readMetrics() const
+{
+    QList<qint64> latencies;
+    ReadMetrics metrics;
+    {
+        QMutexLocker lock(&m_latencyLock);
+        latencies = m_latencies;
+        metrics.reads = m_reads;
+    }
+
+    if (latencies.isEmpty())
+        return metrics;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    const auto percentile = [&latencies](int p)
+    {
+        return latencies[(latencies.size() - 1) * p / 100];
+    };
+
+    metrics.p50 = percentile(50);
+    metrics.p90 = percentile(90);
+    metrics.p99 = percentile(99);
+    metrics.max = latencies.last();
+    return metrics;
+}
+
+// reads are spread over readers in turn, latency counts the time spent in queue too
+template<typename Result, typename Arg>
+QFuture<Result> FileHistoryDB::invokeReader(void (FileHistoryDBReader::*method)(QPromise<Result> &, const Arg &)
+                                            , const Arg &arg)
+{
+    auto reader = m_readers[m_nextReader++ % READERS];
+
+    QElapsedTimer requested;
+    requested.start();
+
+    QPromise<Result> promise;
+    QFuture<Result> future = promise.future();
+    QMetaObject::invokeMethod(reader, [this, reader, promise = std::move(promise), arg, method, requested]() mutable
+    {
+        std::invoke(method, reader, std::ref(promise), arg);
+        recordRead(requested.nsecsElapsed() / 1000);
+    });
+
+    return future;
+}
+
+void FileHistoryDB::recordRead(qint64 usecs)
+{
+    QMutexLocker lock(&m_latencyLock);
+    if (m_latencies.size() < READ_SAMPLES)
+        m_latencies.push_back(usecs);
+    else
+        m_latencies[m_reads % READ_SAMPLES] = usecs;
+
+    ++m_reads;
+}
+
+void FileHistoryDB::setFolderSummary(const QString &path, const FolderSummary &summary)
+{
+    m_worker->setFolderSummary(path, summary);
+}
+
+QFuture<qint64> FileHistoryDB::apply(BulkOperation operation, const QStringList &mrls, const QString &tree)
+{
+    QPromise<qint64> promise;
+    QFuture<qint64> future = promise.future();
+    QMetaObject::invokeMethod(m_worker, [worker = m_worker, promise = std::move(promise), operation, mrls, tree]() mutable
+    {
+        worker->apply(promise, operation, mrls, tree);
+    });
+
+    return future;
+}
+
+QFuture<FileHistoryDB::FolderSummary> FileHistoryDB::readFolderSummary(const QString &path)
+{
+    return invokeWorker<FolderSummary>(m_worker, &FileHistoryDBWorker::readFolderSummary, path);
 }
 
 
@@ -96,49 +273,362 @@ void FileHistoryDBWorker::open(const QString &db)
         return;
     }
 
-    QSqlQuery q("CREATE TABLE IF NOT EXISTS files ("
-                "   MRL TEXT PRIMARY KEY,"
-                "   SEEN BOOL,"
-                "   PROGRESS DECIMAL,"
-                "   PREVIEWED BOOL"
-                ")", *m_db);
+    // FULL would move pages on every commit, free pages are reclaimed on close(),
+    // only takes effect before first table is created
+    enableIncrementalVacuum(*m_db);
+
+    // readers don't block the writer and commits don't wait for a checkpoint
+    executeQuery(*m_db, "PRAGMA journal_mode = WAL");
+    executeQuery(*m_db, "PRAGMA synchronous = NORMAL");
+
+    /*
+     * paths are interned, every directory is stored once and entries refer to it by id,
+     * so lookups are integer keyed and the repeated prefixes are gone, full PATH of
+     * directory is kept so that a subtree is a range scan on its index
+     *
+     * FILES, SEEN, PREVIEWED, PROGRESS summarize direct files of directory, TOTAL_ ones
+     * also include everything below it
+     */
+    const char *const schema[] = {
+        "CREATE TABLE IF NOT EXISTS directories ("
+        "   ID INTEGER PRIMARY KEY,"
+        "   PARENT INTEGER REFERENCES directories(ID),"
+        "   PATH TEXT NOT NULL UNIQUE,"
+        "   FILES INTEGER DEFAULT 0,"
+        "   SEEN INTEGER DEFAULT 0,"
+        "   PREVIEWED INTEGER DEFAULT 0,"
+        "   PROGRESS DECIMAL DEFAULT 0,"
+        "   TOTAL_FILES INTEGER DEFAULT 0,"
+        "   TOTAL_SEEN INTEGER DEFAULT 0,"
+        "   TOTAL_PREVIEWED INTEGER DEFAULT 0,"
+        "   TOTAL_PROGRESS DECIMAL DEFAULT 0"
+        ")",
+
+        "CREATE INDEX IF NOT EXISTS directories_parent ON directories (PARENT)",
+
+        "CREATE TABLE IF NOT EXISTS entries ("
+        "   DIR INTEGER NOT NULL REFERENCES directories(ID),"
+        "   NAME TEXT NOT NULL,"
+        "   SEEN BOOL,"
+        "   PROGRESS DECIMAL,"
+        "   PREVIEWED BOOL,"
+        "   PRIMARY KEY (DIR, NAME)"
+        ") WITHOUT ROWID"
+    };
 
-    if (!q.exec())
+    for (const auto statement : schema)
     {
-        qFatal() << "failed to execute query" << q.lastError();
+        QSqlQuery q(*m_db);
+        if (!q.exec(statement))
+        {
+            qFatal() << "failed to execute query" << q.lastError();
+            return;
+        }
+    }
+
+    migrate();
+
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FLUSH_INTERVAL);
+    connect(m_flushTimer, &QTimer::timeout, this, &FileHistoryDBWorker::flush);
+}
+
+// moves rows of the MRL keyed layout to interned one
+void FileHistoryDBWorker::migrate()
+{
+    QSqlQuery version(*m_db);
+    if (!version.exec("PRAGMA user_version") || !version.next())
+    {
+        qWarning() << "failed to read schema version" << version.lastError();
         return;
     }
 
-    enableAutoVacuum(*m_db);
+    if (version.value(0).toInt() >= SCHEMA_VERSION)
+        return;
+
+    version.finish();
+
+    const auto tables = m_db->tables();
+
+    m_db->transaction();
+
+    if (tables.contains("files"))
+    {
+        auto &insert = prepared("INSERT OR REPLACE INTO entries (DIR, NAME, SEEN, PROGRESS, PREVIEWED)"
+                                " VALUES (:dir, :name, :seen, :progress, :previewed)");
+
+        QSqlQuery files(*m_db);
+        files.setForwardOnly(true);
+        files.exec("SELECT MRL, SEEN, PROGRESS, PREVIEWED FROM files");
+
+        qint64 count = 0;
+        while (files.next())
+        {
+            const auto [dir, name] = splitPath(files.value(0).toString());
+            const auto id = directoryId(dir, true);
+            if (id < 0)
+                continue;
+
+            insert.bindValue(":dir", id);
+            insert.bindValue(":name", name);
+            insert.bindValue(":seen", files.value(1));
+            insert.bindValue(":progress", files.value(2));
+            insert.bindValue(":previewed", files.value(3));
+            if (!insert.exec())
+            {
+                qWarning() << "failed to migrate" << files.value(0) << insert.lastError();
+                m_db->rollback();
+                m_directoryIds.clear();
+                return;
+            }
+
+            ++count;
+        }
+
+        qDebug() << "migrated history of" << count << "files";
+    }
+
+    if (tables.contains("folders"))
+    {
+        auto &update = prepared("UPDATE directories SET FILES = :files, SEEN = :seen"
+                                ", PREVIEWED = :previewed, PROGRESS = :progress"
+                                ", TOTAL_FILES = :total_files, TOTAL_SEEN = :total_seen"
+                                ", TOTAL_PREVIEWED = :total_previewed, TOTAL_PROGRESS = :total_progress"
+                                " WHERE ID = :id");
+
+        QSqlQuery folders(*m_db);
+        folders.setForwardOnly(true);
+        folders.exec("SELECT PATH, FILES, SEEN, PREVIEWED, PROGRESS"
+                     ", TOTAL_FILES, TOTAL_SEEN, TOTAL_PREVIEWED, TOTAL_PROGRESS FROM folders");
+
+        while (folders.next())
+        {
+            const auto id = directoryId(folders.value(0).toString(), true);
+            if (id < 0)
+                continue;
+
+            const auto direct = summaryAt(folders, 1);
+            const auto total = summaryAt(folders, 5);
+
+            update.bindValue(":id", id);
+            update.bindValue(":files", direct.files);
+            update.bindValue(":seen", direct.seen);
+            update.bindValue(":previewed", direct.previewed);
+            update.bindValue(":progress", direct.progress);
+            update.bindValue(":total_files", total.files);
+            update.bindValue(":total_seen", total.seen);
+            update.bindValue(":total_previewed", total.previewed);
+            update.bindValue(":total_progress", total.progress);
+            if (!update.exec())
+            {
+                qWarning() << "failed to migrate" << folders.value(0) << update.lastError();
+                m_db->rollback();
+                m_directoryIds.clear();
+                return;
+            }
+        }
+    }
+
+    executeQuery(*m_db, "DROP TABLE IF EXISTS files");
+    executeQuery(*m_db, "DROP TABLE IF EXISTS folders");
+    executeQuery(*m_db, QString("PRAGMA user_version = %1").arg(SCHEMA_VERSION));
+
+    if (!m_db->commit())
+        qWarning() << "failed to migrate history" << m_db->lastError();
 }
 
-void FileHistoryDBWorker::read(QPromise<FileHistoryDB::Data> &result, const QString &mrl)
+FileHistoryDBWorker::~FileHistoryDBWorker()
+{
+    close();
+}
+
+void FileHistoryDBWorker::close()
 {
     if (!m_db || !m_db->isOpen())
+        return;
+
+    flush();
+    executeQuery(*m_db, "PRAGMA incremental_vacuum");
+
+    m_statements.clear();
+    m_db->close();
+}
+
+FileHistoryDB::DataMap FileHistoryDBWorker::pending(const QStringList &mrls)
+{
+    FileHistoryDB::DataMap r;
+
+    QMutexLocker lock(&m_pendingLock);
+    if (m_pending.isEmpty() && m_flushing.isEmpty())
+        return r;
+
+    for (const auto &mrl : mrls)
     {
-        qFatal("Database is not open");
+        const auto flushing = m_flushing.constFind(mrl);
+        const auto pending = m_pending.constFind(mrl);
+        if (flushing == m_flushing.constEnd() && pending == m_pending.constEnd())
+            continue;
+
+        auto &data = r[mrl];
+        if (flushing != m_flushing.constEnd())
+            merge(*flushing, data);
+        if (pending != m_pending.constEnd())
+            merge(*pending, data);
+    }
+
+    return r;
+}
+
+FileHistoryDBReader::FileHistoryDBReader(FileHistoryDBWorker *writer)
+    : m_writer {writer}
+    , m_connectionName {QString("filehistory-reader-%1").arg(quintptr(this))}
+{
+}
+
+FileHistoryDBReader::~FileHistoryDBReader()
+{
+    close();
+}
+
+void FileHistoryDBReader::open(const QString &db)
+{
+    m_db = std::unique_ptr<QSqlDatabase>(
+                new QSqlDatabase(QSqlDatabase::addDatabase("QSQLITE", m_connectionName)));
+
+    m_db->setDatabaseName(db);
+    m_db->setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!m_db->open())
+        qWarning("failed to open reader of database %s", qUtf8Printable(db));
+}
+
+void FileHistoryDBReader::close()
+{
+    if (!m_db)
         return;
+
+    m_statements.clear();
+    m_directoryIds.clear();
+    m_db->close();
+    m_db.reset();
+
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+// pending writes are taken before querying, whatever is flushed in between is in the db
+void FileHistoryDBReader::read(QPromise<FileHistoryDB::Data> &result, const QString &mrl)
+{
+    const auto pending = m_writer->pending({mrl});
+
+    auto data = readEntry(mrl);
+    if (const auto itr = pending.constFind(mrl); itr != pending.constEnd())
+        merge(*itr, data);
+
+    result.start();
+    result.addResult(std::move(data));
+    result.finish();
+}
+
+void FileHistoryDBReader::readBatch(QPromise<FileHistoryDB::DataMap> &result, const QStringList &mrls)
+{
+    const auto pending = m_writer->pending(mrls);
+
+    auto r = readEntries(mrls);
+    for (auto itr = pending.cbegin(); itr != pending.cend(); ++itr)
+        merge(*itr, r[itr.key()]);
+
+    result.start();
+    result.addResult(std::move(r));
+    result.finish();
+}
+
+QSqlQuery &FileHistoryDBConnection::prepared(const QString &statement)
+{
+    auto &query = m_statements[statement];
+    if (!query)
+    {
+        query = std::make_shared<QSqlQuery>(*m_db);
+        if (!query->prepare(statement))
+        {
+            qWarning("failed to prepare '%s' - error '%s'"
+                     , qUtf8Printable(statement)
+                     , qUtf8Printable(query->lastError().text()));
+        }
     }
 
-    const auto reportError = [&](const QString error)
+    return *query;
+}
+
+// id of directory at @path, -1 if it's not stored and @create is false, ancestors are
+// created along with it
+qint64 FileHistoryDBConnection::directoryId(const QString &path, bool create)
+{
+    if (path.isNull())
+        return -1;
+
+    if (const auto itr = m_directoryIds.constFind(path); itr != m_directoryIds.constEnd())
+        return *itr;
+
+    auto &select = prepared("SELECT ID FROM directories WHERE PATH = :path");
+    select.bindValue(":path", path);
+    if (select.exec() && select.next())
     {
-        qFatal("failed to read for '%s' - error '%s'"
-               , qUtf8Printable(mrl)
-               , qUtf8Printable(error));
-    };
+        const auto id = select.value(0).toLongLong();
+        select.finish();
 
+        m_directoryIds.insert(path, id);
+        return id;
+    }
 
-    QSqlQuery query(*m_db);
-    query.prepare("SELECT SEEN, PROGRESS, PREVIEWED FROM files WHERE MRL = :mrl");
-    query.bindValue(":mrl", mrl);
+    select.finish();
+    if (!create)
+        return -1;
 
-    if (!query.exec())
+    const auto parent = parentPath(path);
+    const auto parentId = parent.isNull() ? -1 : directoryId(parent, true);
+
+    auto &insert = prepared("INSERT INTO directories (PARENT, PATH) VALUES (:parent, :path)");
+    insert.bindValue(":parent", parentId < 0 ? QVariant {} : QVariant(parentId));
+    insert.bindValue(":path", path);
+    if (!insert.exec())
     {
-        reportError(query.lastError().text());
-        return;
+        qWarning("failed to add directory '%s' - error '%s'"
+                 , qUtf8Printable(path)
+                 , qUtf8Printable(insert.lastError().text()));
+        return -1;
     }
 
+    const auto id = insert.lastInsertId().toLongLong();
+    m_directoryIds.insert(path, id);
+    return id;
+}
+
+FileHistoryDB::Data FileHistoryDBConnection::readEntry(const QString &mrl)
+{
     FileHistoryDB::Data data;
+    if (!m_db || !m_db->isOpen())
+    {
+        qWarning("Database is not open");
+        return data;
+    }
+
+    const auto [dir, name] = splitPath(mrl);
+    const auto id = directoryId(dir, false);
+    if (id < 0)
+        return data;
+
+    auto &query = prepared("SELECT SEEN, PROGRESS, PREVIEWED FROM entries WHERE DIR = :dir AND NAME = :name");
+    query.bindValue(":dir", id);
+    query.bindValue(":name", name);
+
+    if (!query.exec())
+    {
+        qWarning("failed to read for '%s' - error '%s'"
+                 , qUtf8Printable(mrl)
+                 , qUtf8Printable(query.lastError().text()));
+        return data;
+    }
+
     if (query.next())
     {
         data.seen = get<bool>(query, 0);
@@ -146,15 +636,67 @@ void FileHistoryDBWorker::read(QPromise<FileHistoryDB::Data> &result, const QStr
         data.previewed = get<bool>(query, 2);
     }
 
-    result.start();
-    result.addResult(std::move(data));
-    result.finish();
+    query.finish();
+    return data;
 }
 
+// batches usually are entries of one directory, each directory is one range scan of entries
+FileHistoryDB::DataMap FileHistoryDBConnection::readEntries(const QStringList &mrls)
+{
+    FileHistoryDB::DataMap r;
+    if (!m_db || !m_db->isOpen())
+    {
+        qWarning("Database is not open");
+        return r;
+    }
+
+    // directory -> basename -> mrl
+    QHash<QString, QHash<QString, QString>> directories;
+    for (const auto &mrl : mrls)
+    {
+        const auto [dir, name] = splitPath(mrl);
+        directories[dir].insert(name, mrl);
+    }
+
+    r.reserve(mrls.size());
+
+    auto &query = prepared("SELECT NAME, SEEN, PROGRESS, PREVIEWED FROM entries WHERE DIR = :dir");
+    for (auto dir = directories.cbegin(); dir != directories.cend(); ++dir)
+    {
+        const auto id = directoryId(dir.key(), false);
+        if (id < 0)
+            continue;
+
+        query.bindValue(":dir", id);
+        if (!query.exec())
+        {
+            qWarning("failed batch read of '%s' - error '%s'"
+                     , qUtf8Printable(dir.key())
+                     , qUtf8Printable(query.lastError().text()));
+            continue;
+        }
+
+        while (query.next())
+        {
+            const auto mrl = dir->find(query.value(0).toString());
+            if (mrl == dir->end())
+                continue;
+
+            auto &data = r[*mrl];
+            data.seen = get<bool>(query, 1);
+            data.progress = get<double>(query, 2);
+            data.previewed = get<bool>(query, 3);
+        }
+
+        query.finish();
+    }
+
+    return r;
+}
 
 #define FileHistoryDB_IMPL(type, setter) \
     void FileHistoryDB:: setter (const QString &mrl, const type newValue) { \
-        QMetaObject::invokeMethod(m_worker, #setter, Q_ARG(QString, mrl), Q_ARG(type, newValue)); \
+        m_worker->setter(mrl, newValue); \
     }
 
 FileHistoryDB_IMPL(bool, setSeen)
@@ -164,15 +706,405 @@ FileHistoryDB_IMPL(bool, setPreviewed)
 
 void FileHistoryDBWorker::setSeen(const QString &mrl, bool seen)
 {
-    insert(m_db, "SEEN", mrl, seen);
+    queueWrite(mrl, [seen](FileHistoryDB::Data &data) { data.seen = seen; });
 }
 
 void FileHistoryDBWorker::setProgress(const QString &mrl, double progress)
 {
-    insert(m_db, "PROGRESS", mrl, progress);
+    queueWrite(mrl, [progress](FileHistoryDB::Data &data) { data.progress = progress; });
 }
 
 void FileHistoryDBWorker::setPreviewed(const QString &mrl, const bool previewed)
 {
-    insert(m_db, "PREVIEWED", mrl, previewed);
+    queueWrite(mrl, [previewed](FileHistoryDB::Data &data) { data.previewed = previewed; });
+}
+
+template<typename Update>
+void FileHistoryDBWorker::queueWrite(const QString &mrl, Update update)
+{
+    QMutexLocker lock(&m_pendingLock);
+    update(m_pending[mrl]);
+    scheduleFlushLocked();
+}
+
+void FileHistoryDBWorker::setFolderSummary(const QString &path, const FileHistoryDB::FolderSummary &summary)
+{
+    QMutexLocker lock(&m_pendingLock);
+    m_pendingSummaries.insert(path, summary);
+    scheduleFlushLocked();
+}
+
+void FileHistoryDBWorker::scheduleFlushLocked()
+{
+    // one hop to the worker thread per flush, not per write
+    if (m_flushScheduled)
+        return;
+
+    m_flushScheduled = true;
+    QMetaObject::invokeMethod(this, &FileHistoryDBWorker::scheduleFlush, Qt::QueuedConnection);
+}
+
+void FileHistoryDBWorker::scheduleFlush()
+{
+    if (m_flushTimer && !m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+// all writes since last flush go in one transaction, columns which weren't written keep their values
+void FileHistoryDBWorker::flush()
+{
+    if (m_flushTimer)
+        m_flushTimer->stop();
+
+    if (!m_db || !m_db->isOpen())
+        return;
+
+    // stays visible to readers till it's committed
+    FileHistoryDB::DataMap pending;
+    QHash<QString, FileHistoryDB::FolderSummary> summaries;
+    {
+        QMutexLocker lock(&m_pendingLock);
+        m_flushing = std::move(m_pending);
+        m_pending.clear();
+        summaries = std::exchange(m_pendingSummaries, {});
+        m_flushScheduled = false;
+
+        pending = m_flushing;
+    }
+
+    if (pending.isEmpty() && summaries.isEmpty())
+        return;
+
+    const auto value = [](const auto &optional)
+    {
+        return optional ? QVariant::fromValue(*optional) : QVariant {};
+    };
+
+    m_db->transaction();
+
+    auto &query = prepared("INSERT INTO entries (DIR, NAME, SEEN, PROGRESS, PREVIEWED)"
+                           " VALUES (:dir, :name, :seen, :progress, :previewed)"
+                           " ON CONFLICT(DIR, NAME) DO UPDATE SET"
+                           " SEEN = COALESCE(excluded.SEEN, SEEN)"
+                           ", PROGRESS = COALESCE(excluded.PROGRESS, PROGRESS)"
+                           ", PREVIEWED = COALESCE(excluded.PREVIEWED, PREVIEWED)");
+
+    for (auto itr = pending.cbegin(); itr != pending.cend(); ++itr)
+    {
+        const auto [dir, name] = splitPath(itr.key());
+        const auto id = directoryId(dir, true);
+        if (id < 0)
+        {
+            qWarning("Failed to update mrl '%s', it's not a path", qUtf8Printable(itr.key()));
+            continue;
+        }
+
+        query.bindValue(":dir", id);
+        query.bindValue(":name", name);
+        query.bindValue(":seen", value(itr->seen));
+        query.bindValue(":progress", value(itr->progress));
+        query.bindValue(":previewed", value(itr->previewed));
+
+        if (!query.exec())
+        {
+            qWarning("Failed to update mrl '%s' status: %s"
+                     , qUtf8Printable(itr.key())
+                     , qUtf8Printable(query.lastError().text()));
+        }
+    }
+
+    for (auto itr = summaries.cbegin(); itr != summaries.cend(); ++itr)
+        writeFolderSummary(itr.key(), itr.value());
+
+    if (!m_db->commit())
+    {
+        qWarning("Failed to write %lld pending updates: %s"
+                 , qsizetype(pending.size() + summaries.size())
+                 , qUtf8Printable(m_db->lastError().text()));
+
+        // ids of directories added in this transaction are gone
+        m_directoryIds.clear();
+    }
+
+    QMutexLocker lock(&m_pendingLock);
+    m_flushing.clear();
+}
+
+// a failed summary is undone alone, it doesn't take rest of the flush with it
+bool FileHistoryDBWorker::writeFolderSummary(const QString &path, const FileHistoryDB::FolderSummary &summary)
+{
+    QSqlQuery savepoint(*m_db);
+    if (!savepoint.exec("SAVEPOINT summary"))
+    {
+        qWarning("Failed to update summary: %s", qUtf8Printable(savepoint.lastError().text()));
+        return false;
+    }
+
+    const auto rollback = [this, &savepoint](const QString &error)
+    {
+        qWarning("Failed to update summary: %s", qUtf8Printable(error));
+
+        savepoint.exec("ROLLBACK TO summary");
+        savepoint.exec("RELEASE summary");
+
+        // ids of directories added since savepoint are gone
+        m_directoryIds.clear();
+        return false;
+    };
+
+    const auto id = directoryId(path, true);
+    if (id < 0)
+        return rollback(path);
+
+    auto &previous = prepared("SELECT FILES, SEEN, PREVIEWED, PROGRESS FROM directories WHERE ID = :id");
+    previous.bindValue(":id", id);
+
+    FileHistoryDB::FolderSummary old;
+    if (previous.exec() && previous.next())
+        old = summaryAt(previous, 0);
+
+    previous.finish();
+
+    auto &direct = prepared("UPDATE directories SET FILES = :files, SEEN = :seen"
+                            ", PREVIEWED = :previewed, PROGRESS = :progress WHERE ID = :id");
+    direct.bindValue(":id", id);
+    direct.bindValue(":files", summary.files);
+    direct.bindValue(":seen", summary.seen);
+    direct.bindValue(":previewed", summary.previewed);
+    direct.bindValue(":progress", summary.progress);
+
+    if (!direct.exec())
+        return rollback(direct.lastError().text());
+
+    // only the difference travels up, ancestors don't have to be recounted
+    auto &rollup = prepared("UPDATE directories SET TOTAL_FILES = TOTAL_FILES + :files"
+                            ", TOTAL_SEEN = TOTAL_SEEN + :seen"
+                            ", TOTAL_PREVIEWED = TOTAL_PREVIEWED + :previewed"
+                            ", TOTAL_PROGRESS = TOTAL_PROGRESS + :progress"
+                            " WHERE ID = :id");
+
+    for (QString folder = path; !folder.isNull(); folder = parentPath(folder))
+    {
+        rollup.bindValue(":id", directoryId(folder, true));
+        rollup.bindValue(":files", summary.files - old.files);
+        rollup.bindValue(":seen", summary.seen - old.seen);
+        rollup.bindValue(":previewed", summary.previewed - old.previewed);
+        rollup.bindValue(":progress", summary.progress - old.progress);
+
+        if (!rollup.exec())
+            return rollback(rollup.lastError().text());
+    }
+
+    savepoint.exec("RELEASE summary");
+    return true;
+}
+
+void FileHistoryDBWorker::readFolderSummary(QPromise<FileHistoryDB::FolderSummary> &result, const QString &path)
+{
+    if (!m_db || !m_db->isOpen())
+    {
+        qFatal("Database is not open");
+        return;
+    }
+
+    bool summariesPending;
+    {
+        QMutexLocker lock(&m_pendingLock);
+        summariesPending = !m_pendingSummaries.isEmpty();
+    }
+
+    // totals have to include summaries which are still queued
+    if (summariesPending)
+        flush();
+
+    FileHistoryDB::FolderSummary summary;
+    if (const auto id = directoryId(path, false); id >= 0)
+    {
+        auto &query = prepared("SELECT TOTAL_FILES, TOTAL_SEEN, TOTAL_PREVIEWED, TOTAL_PROGRESS FROM directories WHERE ID = :id");
+        query.bindValue(":id", id);
+
+        if (!query.exec())
+        {
+            qWarning("failed to read summary of '%s' - error '%s'"
+                     , qUtf8Printable(path)
+                     , qUtf8Printable(query.lastError().text()));
+        }
+        else if (query.next())
+        {
+            summary = summaryAt(query, 0);
+        }
+
+        query.finish();
+    }
+
+    result.start();
+    result.addResult(std::move(summary));
+    result.finish();
+}
+
+void FileHistoryDBWorker::apply(QPromise<qint64> &result
+                                , FileHistoryDB::BulkOperation operation
+                                , const QStringList &mrls
+                                , const QString &tree)
+{
+    result.start();
+
+    if (!m_db || !m_db->isOpen())
+    {
+        qWarning("Database is not open");
+        result.addResult(0);
+        result.finish();
+        return;
+    }
+
+    // earlier writes must not land over this
+    flush();
+
+    m_db->transaction();
+
+    qint64 written = applyToEntries(operation, mrls);
+    if (written >= 0 && !tree.isEmpty())
+    {
+        const auto inTree = applyToTree(operation, tree);
+        written = inTree >= 0 ? written + inTree : -1;
+    }
+
+    if (written < 0 || !m_db->commit())
+    {
+        qWarning("Failed to apply bulk operation: %s", qUtf8Printable(m_db->lastError().text()));
+
+        m_db->rollback();
+        m_directoryIds.clear();
+        written = 0;
+    }
+
+    result.addResult(written);
+    result.finish();
+}
+
+// one statement per directory, names are passed as one json array
+qint64 FileHistoryDBWorker::applyToEntries(FileHistoryDB::BulkOperation operation, const QStringList &mrls)
+{
+    if (mrls.isEmpty())
+        return 0;
+
+    QHash<QString, QJsonArray> directories;
+    for (const auto &mrl : mrls)
+    {
+        const auto [dir, name] = splitPath(mrl);
+        directories[dir].append(name);
+    }
+
+    const auto [column, value] = bulkColumn(operation);
+
+    // only MarkSeen has to add entries, for others no entry means nothing to undo
+    auto &query = operation == FileHistoryDB::BulkOperation::MarkSeen
+            ? prepared(QString("INSERT INTO entries (DIR, NAME, %1)"
+                               " SELECT :dir, value, :value FROM json_each(:names) WHERE true"
+                               " ON CONFLICT(DIR, NAME) DO UPDATE SET %1 = excluded.%1").arg(column))
+            : prepared(QString("UPDATE entries SET %1 = :value"
+                               " WHERE DIR = :dir AND NAME IN (SELECT value FROM json_each(:names))").arg(column));
+
+    qint64 written = 0;
+    for (auto dir = directories.cbegin(); dir != directories.cend(); ++dir)
+    {
+        const auto id = directoryId(dir.key(), operation == FileHistoryDB::BulkOperation::MarkSeen);
+        if (id < 0)
+            continue;
+
+        query.bindValue(":dir", id);
+        query.bindValue(":value", value);
+        query.bindValue(":names", QString::fromUtf8(QJsonDocument(*dir).toJson(QJsonDocument::Compact)));
+        if (!query.exec())
+        {
+            qWarning("failed bulk update of '%s' - error '%s'"
+                     , qUtf8Printable(dir.key())
+                     , qUtf8Printable(query.lastError().text()));
+            return -1;
+        }
+
+        written += query.numRowsAffected();
+    }
+
+    return written;
+}
+
+// folder summaries of @tree are derived again from direct columns, @tree's change of
+// totals is rolled up into its ancestors like setFolderSummary() does
+qint64 FileHistoryDBWorker::applyToTree(FileHistoryDB::BulkOperation operation, const QString &tree)
+{
+    const auto [column, value] = bulkColumn(operation);
+    const auto fail = [](const QSqlQuery &query)
+    {
+        qWarning("failed bulk update of tree - error '%s'", qUtf8Printable(query.lastError().text()));
+        return -1;
+    };
+
+    auto &entries = prepared(QString("UPDATE entries SET %1 = :value"
+                                     " WHERE DIR IN (SELECT ID FROM directories WHERE %2)")
+                             .arg(column, subtreeCondition()));
+    bindSubtree(entries, tree);
+    entries.bindValue(":value", value);
+    if (!entries.exec())
+        return fail(entries);
+
+    const auto written = entries.numRowsAffected();
+
+    const auto id = directoryId(tree, false);
+    if (id < 0)
+        return written;
+
+    auto &total = prepared(QString("SELECT TOTAL_%1 FROM directories WHERE ID = :id").arg(column));
+    const auto readTotal = [&total, id]()
+    {
+        total.bindValue(":id", id);
+        const auto r = total.exec() && total.next() ? total.value(0).toDouble() : 0.0;
+        total.finish();
+        return r;
+    };
+
+    const auto before = readTotal();
+
+    // SEEN of a folder counts its seen files, files without history weren't marked
+    // and entries of sub folders aren't files
+    const QString seenFiles = "MIN(FILES, (SELECT COUNT(*) FROM entries AS e"
+                              " WHERE e.DIR = directories.ID AND e.SEEN = 1"
+                              " AND NOT EXISTS (SELECT 1 FROM directories AS c"
+                              "  WHERE c.PATH = rtrim(directories.PATH, '/') || '/' || e.NAME)))";
+
+    auto &direct = prepared(QString("UPDATE directories SET %1 = %2 WHERE %3")
+                            .arg(column
+                                 , operation == FileHistoryDB::BulkOperation::MarkSeen ? seenFiles : QString("0")
+                                 , subtreeCondition()));
+    bindSubtree(direct, tree);
+    if (!direct.exec())
+        return fail(direct);
+
+    auto &totals = prepared(QString("UPDATE directories AS d SET TOTAL_%1 ="
+                                    " (SELECT SUM(s.%1) FROM directories AS s"
+                                    "  WHERE s.PATH = d.PATH"
+                                    "   OR (s.PATH >= rtrim(d.PATH, '/') || '/' AND s.PATH < rtrim(d.PATH, '/') || '0'))"
+                                    " WHERE %2").arg(column, subtreeCondition()));
+    bindSubtree(totals, tree);
+    if (!totals.exec())
+        return fail(totals);
+
+    const auto delta = readTotal() - before;
+    if (delta == 0)
+        return written;
+
+    auto &rollup = prepared(QString("UPDATE directories SET TOTAL_%1 = TOTAL_%1 + :delta WHERE ID = :id").arg(column));
+    for (QString folder = parentPath(tree); !folder.isNull(); folder = parentPath(folder))
+    {
+        const auto ancestor = directoryId(folder, false);
+        if (ancestor < 0)
+            continue;
+
+        rollup.bindValue(":id", ancestor);
+        rollup.bindValue(":delta", delta);
+        if (!rollup.exec())
+            return fail(rollup);
+    }
+
+    return written;
 }
@@ -3,8 +3,15 @@
 #include <QObject>
 #include <QThread>
 #include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QPromise>
+
+#include <array>
+#include <atomic>
 
 class FileHistoryDBWorker;
+class FileHistoryDBReader;
 
 class FileHistoryDB : public QObject
 {
@@ -17,6 +24,48 @@ public:
         std::optional<bool> previewed;
     };
 
+    using DataMap = QHash<QString, Data>;
+
+    // aggregates over files of a folder
+    struct FolderSummary
+    {
+        qint64 files = 0;
+        qint64 seen = 0;
+        qint64 previewed = 0;
+        double progress = 0;   // sum of progress of all files
+
+        bool operator==(const FolderSummary &other) const
+        {
+            return files == other.files && seen == other.seen
+                   && previewed == other.previewed && progress == other.progress;
+        }
+
+        bool operator!=(const FolderSummary &other) const { return !(*this == other); }
+    };
+
+    // reads are served by READERS read-only connections, so they aren't queued behind writes
+    static constexpr int READERS = 2;
+
+    // latency percentiles are over last READ_SAMPLES reads
+    static constexpr int READ_SAMPLES = 1024;
+
+    // from request of read till its result, in usecs
+    struct ReadMetrics
+    {
+        qint64 reads = 0; // reads so far
+        qint64 p50 = 0;
+        qint64 p90 = 0;
+        qint64 p99 = 0;
+        qint64 max = 0;
+    };
+
+    enum class BulkOperation
+    {
+        MarkSeen,
+        MarkUnseen,
+        ResetProgress
+    };
+
     explicit FileHistoryDB(const QString &source
                             ,QObject *parent = nullptr);
 
@@ -24,12 +73,46 @@ public:
 
     QFuture<Data> read(const QString &mrl);
 
+    // one query for all of @mrls, those without history are left out
+    QFuture<DataMap> readBatch(const QStringList &mrls);
+
     void setSeen(const QString &mrl, const bool seen);
     void setProgress(const QString &mrl, const double progress);
     void setPreviewed(const QString &mrl, const bool previewed);
 
+    // @summary covers direct files of @path, it replaces previous one and the difference
+    // is rolled up into every ancestor of @path, it's written with next flush of pending writes
+    void setFolderSummary(const QString &path, const FolderSummary &summary);
+
+    // files of @path and of all folders below it which were summarized, one indexed lookup
+    QFuture<FolderSummary> readFolderSummary(const QString &path);
+
+    // applies @operation in one transaction, to @mrls with one statement per directory of them
+    // and, if @tree isn't empty, to every entry with history in @tree or below it with one
+    // statement, folder summaries of @tree are updated to match, result is entries written
+    //
+    // files without history aren't known to db, MarkSeen only reaches them through @mrls
+    QFuture<qint64> apply(BulkOperation operation, const QStringList &mrls, const QString &tree = {});
+
+    // thread-safe
+    ReadMetrics readMetrics() const;
+
 private:
+    template<typename Result, typename Arg>
+    QFuture<Result> invokeReader(void (FileHistoryDBReader::*method)(QPromise<Result> &, const Arg &)
+                                 , const Arg &arg);
+
+    void recordRead(qint64 usecs);
+
     QThread m_workerThread;
     FileHistoryDBWorker *m_worker;
+
+    std::array<QThread, READERS> m_readerThreads;
+    std::array<FileHistoryDBReader *, READERS> m_readers {};
+    std::atomic<unsigned> m_nextReader {0};
+
+    mutable QMutex m_latencyLock;
+    QList<qint64> m_latencies; // ring of last READ_SAMPLES
+    qint64 m_reads = 0;
 };
 
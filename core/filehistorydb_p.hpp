@@ -3,30 +3,130 @@
 
 #include <QObject>
 #include <QFuture>
+#include <QHash>
+#include <QMutex>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 
 #include "filehistorydb.hpp"
 
+class QTimer;
 
-class FileHistoryDBWorker : public QObject
+// connection to history db, it's only used by thread which opened it
+class FileHistoryDBConnection : public QObject
 {
     Q_OBJECT
 
 public:
     using QObject::QObject;
 
-public slots:
-    void open(const QString &db);
+protected:
+    // prepared on first use, reused for every execution after
+    QSqlQuery &prepared(const QString &statement);
 
-    void read(QPromise<FileHistoryDB::Data> &result, const QString &mrl);
+    qint64 directoryId(const QString &path, bool create);
+
+    // history as stored in db, unflushed writes are not included
+    FileHistoryDB::Data readEntry(const QString &mrl);
+
+    // mrls without history are left out
+    FileHistoryDB::DataMap readEntries(const QStringList &mrls);
+
+    std::unique_ptr<QSqlDatabase> m_db;
+
+    QHash<QString, std::shared_ptr<QSqlQuery>> m_statements;
+
+    // path -> id in directories
+    QHash<QString, qint64> m_directoryIds;
+};
+
+// only writer of db, it creates and migrates the schema
+class FileHistoryDBWorker : public FileHistoryDBConnection
+{
+    Q_OBJECT
+
+public:
+    // pending writes are flushed in one transaction at most this often
+    static constexpr int FLUSH_INTERVAL = 2000;
 
+    using FileHistoryDBConnection::FileHistoryDBConnection;
+    ~FileHistoryDBWorker();
+
+    // thread-safe, writes are kept in memory per mrl, a later write to same mrl
+    // replaces an earlier one, they reach db on next flush
     void setSeen(const QString &mrl, bool seen);
 
     void setProgress(const QString &mrl, double progress);
 
     void setPreviewed(const QString &mrl, bool previewed);
 
+    // thread-safe, only the latest summary of @path is kept till next flush
+    void setFolderSummary(const QString &path, const FileHistoryDB::FolderSummary &summary);
+
+    // thread-safe, writes to @mrls which aren't committed yet
+    FileHistoryDB::DataMap pending(const QStringList &mrls);
+
+public slots:
+    void open(const QString &db);
+
+    // writes pending writes and reclaims free pages
+    void close();
+
+    void apply(QPromise<qint64> &result
+               , FileHistoryDB::BulkOperation operation
+               , const QStringList &mrls
+               , const QString &tree);
+
+    void readFolderSummary(QPromise<FileHistoryDB::FolderSummary> &result, const QString &path);
+
+    void flush();
+
+private slots:
+    void scheduleFlush();
 
 private:
-    std::unique_ptr<QSqlDatabase> m_db;
+    template<typename Update>
+    void queueWrite(const QString &mrl, Update update);
+
+    // m_pendingLock must be held
+    void scheduleFlushLocked();
+
+    void migrate();
+
+    // runs inside flush's transaction
+    bool writeFolderSummary(const QString &path, const FileHistoryDB::FolderSummary &summary);
+
+    qint64 applyToEntries(FileHistoryDB::BulkOperation operation, const QStringList &mrls);
+    qint64 applyToTree(FileHistoryDB::BulkOperation operation, const QString &tree);
+
+    QTimer *m_flushTimer = nullptr;
+
+    QMutex m_pendingLock;
+    FileHistoryDB::DataMap m_pending;
+    FileHistoryDB::DataMap m_flushing; // taken by flush, not committed yet
+    QHash<QString, FileHistoryDB::FolderSummary> m_pendingSummaries;
+    bool m_flushScheduled = false;
+};
+
+// read-only connection, with WAL it isn't blocked by the writer
+class FileHistoryDBReader : public FileHistoryDBConnection
+{
+    Q_OBJECT
+
+public:
+    explicit FileHistoryDBReader(FileHistoryDBWorker *writer);
+    ~FileHistoryDBReader();
+
+public slots:
+    void open(const QString &db);
+
+    void close();
+
+    void read(QPromise<FileHistoryDB::Data> &result, const QString &mrl);
+
+    void readBatch(QPromise<FileHistoryDB::DataMap> &result, const QStringList &mrls);
+
+private:
+    FileHistoryDBWorker *const m_writer;
+    const QString m_connectionName;
 };
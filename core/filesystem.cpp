@@ -1,43 +1,151 @@
 #include "filesystem.hpp"
+#include "incrementalnotifier.hpp"
 
 #include <QUrl>
 #include <QDir>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#ifdef Q_OS_LINUX
+#include "linuxdirscanner.hpp"
+#include "linuxdirwatcher.hpp"
+#endif
 
 const QString LEAN_URL_SCEHEME = u"lean-dir"_qs;
 
 namespace
 {
 
+// times are msecs since epoch, 0 if not available
 struct EntryInfo
 {
     QString name;
     QString path;
     qint64 size;
+    qint64 lastAccessTime;
+    qint64 creationTime;
+    qint64 modifiedTime;
     bool isdir;
 };
 
-class RegularDirectory : public Directory
+EntryInfo entryInfo(const QFileInfo &fileInfo)
+{
+    return EntryInfo
+    {
+        fileInfo.fileName()
+        , fileInfo.absoluteFilePath()
+        , fileInfo.size()
+        , DirectoryColumns::toMSecs(fileInfo.lastRead())
+        , DirectoryColumns::toMSecs(fileInfo.birthTime())
+        , DirectoryColumns::toMSecs(fileInfo.lastModified())
+        , fileInfo.isDir()
+    };
+}
+
+bool sameEntry(const EntryInfo &l, const EntryInfo &r)
+{
+    return l.size == r.size
+           && l.lastAccessTime == r.lastAccessTime
+           && l.creationTime == r.creationTime
+           && l.modifiedTime == r.modifiedTime
+           && l.isdir == r.isdir;
+}
+
+class DirectoryWatch;
+
+class RegularDirectory : public Directory, public WatchedDirectory
 {
 public:
+    ~RegularDirectory();
+
     QString directoryPath;
     QString directoryName;
     QVector<EntryInfo> entries;
 
+    // only set for directories which change after open(), entries are read with it held
+    std::unique_ptr<QReadWriteLock> lock;
+
+    // optional, follows changes on disk while a change callback is set
+    std::unique_ptr<DirectoryWatch> watch;
+
+    DirectoryType type() const override { return DirectoryType::FileSystem; }
+
     QString name() override { return directoryName; }
     QString path() override { return directoryPath; }
 
-    int fileCount() override { return entries.size(); }
-    QString fileName(int i) override { return entries[i].name; }
-    QString filePath(int i) override { return entries[i].path; }
-    QUrl fileUrl(int i) override { return QUrl::fromLocalFile(entries[i].path); }
-    qint64 fileSize(int i) override { return entries[i].size; }
-    bool isDir(int i) override { return entries[i].isdir; }
+    int fileCount() override { QReadLocker l(lock.get()); return entries.size(); }
+    QString fileName(int i) override { QReadLocker l(lock.get()); return entries[i].name; }
+    QString filePath(int i) override { QReadLocker l(lock.get()); return entries[i].path; }
+    QUrl fileUrl(int i) override { return QUrl::fromLocalFile(filePath(i)); }
+    qint64 fileSize(int i) override { QReadLocker l(lock.get()); return entries[i].size; }
+    bool isDir(int i) override { QReadLocker l(lock.get()); return entries[i].isdir; }
+
+    // all are captured while listing the directory, so these don't touch the disk
+    QDateTime fileLastAccessTime(int i) override
+    {
+        QReadLocker l(lock.get());
+        return DirectoryColumns::fromMSecs(entries[i].lastAccessTime);
+    }
+
+    QDateTime fileCreationTime(int i) override
+    {
+        QReadLocker l(lock.get());
+        return DirectoryColumns::fromMSecs(entries[i].creationTime);
+    }
+
+    QDateTime fileModifiedTime(int i) override
+    {
+        QReadLocker l(lock.get());
+        return DirectoryColumns::fromMSecs(entries[i].modifiedTime);
+    }
+
+    void fill(int first, int count, DirectoryColumns::Fields fields, DirectoryColumns &columns) override
+    {
+        QReadLocker l(lock.get());
 
-    QDateTime fileLastAccessTime(int i) override { return QFileInfo(entries[i].path).lastRead(); }
+        for (int i = first; i < first + count; ++i)
+        {
+            const auto &entry = entries[i];
+            if (fields & DirectoryColumns::Names)
+                columns.names.push_back(entry.name);
+            if (fields & DirectoryColumns::Paths)
+                columns.paths.push_back(entry.path);
+            if (fields & DirectoryColumns::Sizes)
+                columns.sizes.push_back(entry.size);
+            if (fields & DirectoryColumns::Dirs)
+                columns.dirs.push_back(entry.isdir);
+            if (fields & DirectoryColumns::LastAccessTimes)
+                columns.lastAccessTimes.push_back(entry.lastAccessTime);
+            if (fields & DirectoryColumns::CreationTimes)
+                columns.creationTimes.push_back(entry.creationTime);
+            if (fields & DirectoryColumns::ModifiedTimes)
+                columns.modifiedTimes.push_back(entry.modifiedTime);
+        }
+    }
 
-    QDateTime fileCreationTime(int i) override { return QFileInfo(entries[i].path).birthTime(); }
+    void setChangeCallback(ChangeCallback cb) override;
+    void applyChanges(const ChangeHandler &before, const ChangeHandler &after) override;
 
-    QDateTime fileModifiedTime(int i) override { return QFileInfo(entries[i].path).lastModified(); }
+private:
+    // entries are only modified from the thread applying changes, so these read without lock
+    int indexOf(const QString &path);
+    void upsert(EntryInfo &&info, const ChangeHandler &before, const ChangeHandler &after);
+    void resync(std::vector<EntryInfo> &&current, const ChangeHandler &before, const ChangeHandler &after);
+
+    template<typename Predicate>
+    void removeIf(Predicate predicate, const ChangeHandler &before, const ChangeHandler &after);
+
+    // path -> row for entries before m_indexedRows, extended by indexOf(), rows from
+    // a removal onwards are dropped since they shift
+    QHash<QString, int> m_rows;
+    int m_indexedRows = 0;
 };
 
 template<bool LeanMode>
@@ -75,8 +183,88 @@ public:
     }
 };
 
-void addFiles(const QString &path, bool flatMode, RegularDirectory *dir)
+// files of a single directory, in flat mode sub directories are not part of
+// files, they are reported separately to be traversed by caller
+struct DirListing
+{
+    std::vector<EntryInfo> files;
+
+    // (number of files listed before it, path)
+    std::vector<std::pair<int, QString>> subdirs;
+
+    // ids of subdirs, assigned by LeanTraversal
+    std::vector<int> subdirIds;
+};
+
+#ifdef Q_OS_LINUX
+bool listDirNative(const QString &path, bool flatMode, DirListing &listing, const std::atomic<bool> *cancelled)
 {
+    // in flat mode directories are only recursed into, so they don't need a stat
+    std::vector<DirScanEntry> scanned;
+    if (!scanDirectory(QFile::encodeName(path).toStdString(), !flatMode, scanned, cancelled))
+        return false;
+
+    std::vector<QString> names(scanned.size());
+    std::vector<int> order(scanned.size());
+    for (size_t i = 0; i < scanned.size(); ++i)
+    {
+        names[i] = QFile::decodeName(scanned[i].name.c_str());
+        order[i] = int(i);
+    }
+
+    // getdents order depends on the filesystem, same order as QDir's default, which
+    // ignores case
+    std::sort(order.begin(), order.end(), [&names](int l, int r)
+    {
+        return names[l].compare(names[r], Qt::CaseInsensitive) < 0;
+    });
+
+    const QString base = QDir(path).absolutePath();
+    const QString prefix = base.endsWith('/') ? base : base + '/';
+
+    for (const int i : order)
+    {
+        const auto &entry = scanned[i];
+        const QString &name = names[i];
+        const QString filePath = prefix + name;
+
+        if (flatMode && entry.isdir)
+        {
+            listing.subdirs.emplace_back(listing.files.size(), filePath);
+            continue;
+        }
+
+        EntryInfo f
+        {
+            name
+            , filePath
+            , entry.size
+            , entry.lastAccessTime
+            , entry.creationTime
+            , entry.modifiedTime
+            , entry.isdir
+        };
+
+        listing.files.push_back(std::move(f));
+    }
+
+    return true;
+}
+#endif
+
+bool isCancelled(const std::atomic<bool> *cancelled)
+{
+    return cancelled && cancelled->load(std::memory_order_relaxed);
+}
+
+// listing is left empty once @cancelled is set
+void listDir(const QString &path, bool flatMode, DirListing &listing, const std::atomic<bool> *cancelled = nullptr)
+{
+#ifdef Q_OS_LINUX
+    if (listDirNative(path, flatMode, listing, cancelled) || isCancelled(cancelled))
+        return;
+#endif
+
     QDir d(path);
     QFileInfoList list = d.entryInfoList();
 
@@ -88,29 +276,771 @@ void addFiles(const QString &path, bool flatMode, RegularDirectory *dir)
 
         if (flatMode && fileInfo.isDir())
         {
-            addFiles(fileInfo.absoluteFilePath(), flatMode, dir);
+            listing.subdirs.emplace_back(listing.files.size(), fileInfo.absoluteFilePath());
             continue;
         }
 
-        EntryInfo f
+        // QFileInfo from entryInfoList() has the stat result cached
+        listing.files.push_back(entryInfo(fileInfo));
+    }
+}
+
+/*
+ * traverses a directory tree for lean mode with a small pool of workers, each worker
+ * has its own queue of directories and steals from others when it runs out
+ *
+ * listings are kept per directory and stitched together at the end in depth first
+ * order, so the result is the same as a sequential traversal
+ *
+ * with a sink, listings are handed over as soon as they are done instead, order of
+ * entries then depends on scheduling
+ */
+class LeanTraversal
+{
+public:
+    // also bounds the directories open at a time
+    static constexpr int MAX_WORKERS = 16;
+
+    // msecs an idle worker waits before checking for cancellation
+    static constexpr unsigned long IDLE_WAIT = 20;
+
+    // called from worker threads
+    using Sink = std::function<void (std::vector<EntryInfo> &files)>;
+
+    // @out is left untouched once @cancelled is set
+    void run(const QString &root, QVector<EntryInfo> &out, const std::atomic<bool> *cancelled = nullptr)
+    {
+        m_cancelled = cancelled;
+        traverse(root);
+        if (!isCancelled(m_cancelled))
+            collect(0, out);
+    }
+
+    // returns early once @cancelled or @requestCancelled is set
+    void run(const QString &root, Sink sink, const std::atomic<bool> *cancelled
+             , const std::atomic<bool> *requestCancelled = nullptr)
+    {
+        m_sink = std::move(sink);
+        m_cancelled = cancelled;
+        m_requestCancelled = requestCancelled;
+        traverse(root);
+    }
+
+    // absolute paths of all listed directories, including root
+    QStringList directories() const
+    {
+        QStringList r {m_root};
+        for (const auto &worker : m_workers)
+            r += worker.visited;
+
+        return r;
+    }
+
+private:
+    void traverse(const QString &root)
+    {
+        m_root = QDir(root).absolutePath();
+        m_listings.resize(1);
+        listDir(root, true, m_listings[0], m_cancelled);
+        if (m_sink)
+            m_sink(m_listings[0].files);
+
+        if (m_listings[0].subdirs.empty())
+            return;
+
+        const int workerCount = std::clamp(QThread::idealThreadCount() * 2, 2, MAX_WORKERS);
+        m_workers = std::vector<Worker>(workerCount);
+
+        // spread first level over all workers
+        for (size_t i = 0; i < m_listings[0].subdirs.size(); ++i)
+            schedule(m_listings[0], i, i % workerCount);
+
+        QThreadPool pool;
+        pool.setMaxThreadCount(workerCount - 1);
+        for (int i = 1; i < workerCount; ++i)
+            pool.start([this, i]() { work(i); });
+
+        work(0);
+        pool.waitForDone();
+
+        if (m_sink || cancelled())
+            return;
+
+        // gather listings from workers, indexed by directory id
+        m_listings.resize(m_nextId);
+        for (auto &worker : m_workers)
+        {
+            for (auto &[id, listing] : worker.done)
+                m_listings[id] = std::move(listing);
+        }
+    }
+
+    bool cancelled() const
+    {
+        return isCancelled(m_cancelled) || isCancelled(m_requestCancelled);
+    }
+
+    struct Task
+    {
+        QString path;
+        int id;
+    };
+
+    struct Worker
+    {
+        QMutex mutex;
+        std::deque<Task> tasks;
+
+        // (directory id, listing), only touched by owning worker
+        std::vector<std::pair<int, DirListing>> done;
+        QStringList visited;
+    };
+
+    void schedule(DirListing &listing, size_t subdir, int worker)
+    {
+        const int id = m_nextId++;
+        ++m_pending;
+        listing.subdirIds.push_back(id);
+
+        {
+            Worker &w = m_workers[worker];
+            QMutexLocker locker(&w.mutex);
+            w.tasks.push_back({listing.subdirs[subdir].second, id});
+        }
+
+        ++m_queued;
+
+        QMutexLocker locker(&m_idleLock);
+        m_workAvailable.wakeOne();
+    }
+
+    bool takeTask(int self, Task &task)
+    {
+        {
+            // own queue from back, keeps traversal depth first and local
+            Worker &w = m_workers[self];
+            QMutexLocker locker(&w.mutex);
+            if (!w.tasks.empty())
+            {
+                task = std::move(w.tasks.back());
+                w.tasks.pop_back();
+                --m_queued;
+                return true;
+            }
+        }
+
+        // steal from front of others, those are closer to root so likely bigger subtrees
+        const int count = m_workers.size();
+        for (int i = 1; i < count; ++i)
+        {
+            Worker &w = m_workers[(self + i) % count];
+            QMutexLocker locker(&w.mutex);
+            if (!w.tasks.empty())
+            {
+                task = std::move(w.tasks.front());
+                w.tasks.pop_front();
+                --m_queued;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void work(int self)
+    {
+        while (m_pending > 0 && !cancelled())
+        {
+            Task task;
+            if (!takeTask(self, task))
+            {
+                // others are still listing, more work may show up, schedule() and
+                // the last task done wake us, timeout is only for cancellation
+                QMutexLocker locker(&m_idleLock);
+                if (m_queued == 0 && m_pending > 0)
+                    m_workAvailable.wait(&m_idleLock, IDLE_WAIT);
+
+                continue;
+            }
+
+            DirListing listing;
+            listDir(task.path, true, listing, m_cancelled);
+
+            // children are counted before this one is done, so m_pending can't drop to zero early
+            for (size_t i = 0; i < listing.subdirs.size(); ++i)
+                schedule(listing, i, self);
+
+            m_workers[self].visited.push_back(task.path);
+            if (m_sink)
+                m_sink(listing.files);
+            else
+                m_workers[self].done.emplace_back(task.id, std::move(listing));
+
+            if (--m_pending == 0)
+            {
+                QMutexLocker locker(&m_idleLock);
+                m_workAvailable.wakeAll();
+            }
+        }
+    }
+
+    void collect(int id, QVector<EntryInfo> &out)
+    {
+        DirListing &listing = m_listings[id];
+
+        size_t next = 0;
+        for (size_t i = 0; i < listing.subdirs.size(); ++i)
+        {
+            for (; next < size_t(listing.subdirs[i].first); ++next)
+                out.push_back(std::move(listing.files[next]));
+
+            collect(listing.subdirIds[i], out);
+        }
+
+        for (; next < listing.files.size(); ++next)
+            out.push_back(std::move(listing.files[next]));
+    }
+
+    QString m_root;
+    std::vector<DirListing> m_listings;
+    std::vector<Worker> m_workers;
+    Sink m_sink;
+    const std::atomic<bool> *m_cancelled {};
+    const std::atomic<bool> *m_requestCancelled {};
+    std::atomic<int> m_nextId {1};
+    std::atomic<int> m_pending {0};
+
+    // tasks in queues, idle workers wait on m_workAvailable till there are some
+    std::atomic<int> m_queued {0};
+    QMutex m_idleLock;
+    QWaitCondition m_workAvailable;
+};
+
+/*
+ * follows changes of a directory on disk, in lean mode every directory of the tree
+ * is watched, up to MAX_WATCHES
+ *
+ * watching starts once the directory is listed and a callback is set, and stops when
+ * callback is removed, so only directories which are being shown hold inotify
+ * resources, changes before that are missed
+ *
+ * changes are queued from the watcher thread and applied through
+ * WatchedDirectory::applyChanges(), only implemented with inotify
+ */
+class DirectoryWatch
+{
+public:
+    static constexpr int MAX_WATCHES = 8192;
+
+    struct Change
+    {
+        enum Type
         {
-           fileInfo.fileName()
-            , fileInfo.absoluteFilePath()
-            , fileInfo.size()
-            , fileInfo.isDir()
+            Upsert,     // entry created or modified
+            Remove,
+            RemoveTree, // directory removed in lean mode, entries below it go with it
+            Resync      // events were lost, entries is the current content
         };
 
-        dir->entries.push_back(std::move(f));
+        Type type;
+        EntryInfo info; // only path is set for removals
+        std::vector<EntryInfo> entries;
+    };
+
+    DirectoryWatch(const QString &root, bool recursive)
+        : m_root {root}
+        , m_recursive {recursive}
+    {}
+
+    ~DirectoryWatch()
+    {
+        setCallback(nullptr);
+    }
+
+    // @dirs are all directories listed for the directory
+    void setListed(const QStringList &dirs)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_dirs = dirs;
+            m_listed = true;
+        }
+
+        startIfReady();
     }
+
+    void setCallback(WatchedDirectory::ChangeCallback cb)
+    {
+#ifdef Q_OS_LINUX
+        std::unique_ptr<LinuxDirWatcher> stopped;
+#endif
+        {
+            QMutexLocker locker(&m_mutex);
+            m_callback = std::move(cb);
+
+#ifdef Q_OS_LINUX
+            if (!m_callback)
+            {
+                stopped = std::move(m_watcher);
+                m_changes.clear();
+            }
+#endif
+        }
+
+        // joins watcher thread, which may be waiting on m_mutex
+#ifdef Q_OS_LINUX
+        stopped.reset();
+#endif
+        startIfReady();
+    }
+
+    std::vector<Change> takeChanges()
+    {
+        QMutexLocker locker(&m_mutex);
+        return std::exchange(m_changes, {});
+    }
+
+private:
+    static Change removal(Change::Type type, const QString &path)
+    {
+        Change change {type, {}, {}};
+        change.info.path = path;
+        return change;
+    }
+
+    std::vector<EntryInfo> list(const QString &path, QStringList *dirs)
+    {
+        if (m_recursive)
+        {
+            QVector<EntryInfo> files;
+            LeanTraversal traversal;
+            traversal.run(path, files);
+            if (dirs)
+                *dirs = traversal.directories();
+
+            return std::vector<EntryInfo>(std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        }
+
+        DirListing listing;
+        listDir(path, false, listing);
+        return std::move(listing.files);
+    }
+
+    // must be called with m_mutex held
+    void notify()
+    {
+        if (!m_changes.empty() && m_callback)
+            m_callback();
+    }
+
+#ifdef Q_OS_LINUX
+    void startIfReady()
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_watcher || !m_callback || !m_listed)
+            return;
+
+        m_watcher = std::make_unique<LinuxDirWatcher>([this](LinuxDirWatcher::Event event, const std::string &path, bool isdir)
+        {
+            onEvent(event, path, isdir);
+        });
+
+        if (!m_watcher->isValid())
+        {
+            qWarning("failed to watch '%s', inotify is not available", qUtf8Printable(m_root));
+            m_watcher.reset();
+            return;
+        }
+
+        for (const auto &dir : std::as_const(m_dirs))
+        {
+            if (!watchDir(dir))
+                break;
+        }
+    }
+
+    // must be called with m_mutex held, returns false once MAX_WATCHES is reached
+    bool watchDir(const QString &dir)
+    {
+        if (m_watcher->watchCount() >= size_t(MAX_WATCHES))
+        {
+            qInfo("too many directories to watch below '%s'", qUtf8Printable(m_root));
+            return false;
+        }
+
+        // directory may be gone already, its removal is reported by the parent
+        m_watcher->addWatch(QFile::encodeName(dir).toStdString());
+        return true;
+    }
+
+    // called from watcher thread
+    void onEvent(LinuxDirWatcher::Event event, const std::string &path, bool isdir)
+    {
+        const QString filePath = QFile::decodeName(path.c_str());
+        std::vector<Change> changes;
+
+        switch (event)
+        {
+        case LinuxDirWatcher::Event::Created:
+            if (m_recursive && isdir)
+            {
+                // may already have content if it was moved in, watch before listing
+                // so that nothing created meanwhile is missed
+                {
+                    QMutexLocker locker(&m_mutex);
+                    if (!m_watcher)
+                        return;
+
+                    watchDir(filePath);
+                }
+
+                QStringList dirs;
+                for (auto &info : list(filePath, &dirs))
+                    changes.push_back({Change::Upsert, std::move(info), {}});
+
+                QMutexLocker locker(&m_mutex);
+                if (!m_watcher)
+                    return;
+
+                for (const auto &dir : std::as_const(dirs))
+                {
+                    if (dir != filePath && !watchDir(dir))
+                        break;
+                }
+
+                break;
+            }
+            [[fallthrough]];
+        case LinuxDirWatcher::Event::Modified:
+        {
+            // directories are not entries in lean mode
+            const QFileInfo info(filePath);
+            if (!info.exists() || (m_recursive && info.isDir()))
+                return;
+
+            changes.push_back({Change::Upsert, entryInfo(info), {}});
+            break;
+        }
+        case LinuxDirWatcher::Event::Removed:
+            if (m_recursive && isdir)
+            {
+                QMutexLocker locker(&m_mutex);
+                if (m_watcher)
+                    m_watcher->removeWatch(path);
+
+                changes.push_back(removal(Change::RemoveTree, filePath));
+                break;
+            }
+
+            changes.push_back(removal(Change::Remove, filePath));
+            break;
+        case LinuxDirWatcher::Event::Overflow:
+        {
+            qInfo("lost changes of '%s', rescanning", qUtf8Printable(m_root));
+
+            Change change {Change::Resync, {}, list(m_root, nullptr)};
+            changes.push_back(std::move(change));
+            break;
+        }
+        }
+
+        QMutexLocker locker(&m_mutex);
+        if (!m_watcher)
+            return;
+
+        for (auto &change : changes)
+            m_changes.push_back(std::move(change));
+
+        notify();
+    }
+#else
+    void startIfReady() {}
+#endif
+
+    const QString m_root;
+    const bool m_recursive;
+
+    QMutex m_mutex;
+    QStringList m_dirs;
+    bool m_listed = false;
+    WatchedDirectory::ChangeCallback m_callback;
+    std::vector<Change> m_changes;
+
+#ifdef Q_OS_LINUX
+    // last, so that it stops before rest of the state goes away
+    std::unique_ptr<LinuxDirWatcher> m_watcher;
+#endif
+};
+
+RegularDirectory::~RegularDirectory() = default;
+
+// contiguous matches are removed as one range
+template<typename Predicate>
+void RegularDirectory::removeIf(Predicate predicate, const ChangeHandler &before, const ChangeHandler &after)
+{
+    for (int last = entries.size() - 1; last >= 0;)
+    {
+        if (!predicate(entries[last]))
+        {
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && predicate(entries[first - 1]))
+            --first;
+
+        for (int i = first; i < m_indexedRows; ++i)
+            m_rows.remove(entries[i].path);
+
+        m_indexedRows = std::min(m_indexedRows, first);
+
+        const DirectoryChange change {DirectoryChange::Removed, first, last};
+        before(change);
+        {
+            QWriteLocker l(lock.get());
+            entries.remove(first, last - first + 1);
+        }
+        after(change);
+
+        last = first - 1;
+    }
+}
+
+void RegularDirectory::setChangeCallback(ChangeCallback cb)
+{
+    if (watch)
+        watch->setCallback(std::move(cb));
+}
+
+void RegularDirectory::applyChanges(const ChangeHandler &before, const ChangeHandler &after)
+{
+    if (!watch)
+        return;
+
+    using Change = DirectoryWatch::Change;
+    for (auto &change : watch->takeChanges())
+    {
+        switch (change.type)
+        {
+        case Change::Upsert:
+            upsert(std::move(change.info), before, after);
+            break;
+        case Change::Remove:
+            removeIf([&](const EntryInfo &e) { return e.path == change.info.path; }, before, after);
+            break;
+        case Change::RemoveTree:
+        {
+            const QString prefix = change.info.path + '/';
+            removeIf([&](const EntryInfo &e) { return e.path.startsWith(prefix); }, before, after);
+            break;
+        }
+        case Change::Resync:
+            resync(std::move(change.entries), before, after);
+            break;
+        }
+    }
+}
+
+int RegularDirectory::indexOf(const QString &path)
+{
+    // rows appended since last lookup
+    for (; m_indexedRows < entries.size(); ++m_indexedRows)
+        m_rows.insert(entries[m_indexedRows].path, m_indexedRows);
+
+    return m_rows.value(path, -1);
+}
+
+void RegularDirectory::upsert(EntryInfo &&info, const ChangeHandler &before, const ChangeHandler &after)
+{
+    const int row = indexOf(info.path);
+    if (row < 0)
+    {
+        const int last = entries.size();
+        const DirectoryChange change {DirectoryChange::Inserted, last, last};
+
+        before(change);
+        {
+            QWriteLocker l(lock.get());
+            entries.push_back(std::move(info));
+        }
+        after(change);
+        return;
+    }
+
+    if (sameEntry(entries[row], info))
+        return;
+
+    const DirectoryChange change {DirectoryChange::Updated, row, row};
+    before(change);
+    {
+        QWriteLocker l(lock.get());
+        entries[row] = std::move(info);
+    }
+    after(change);
+}
+
+void RegularDirectory::resync(std::vector<EntryInfo> &&current, const ChangeHandler &before, const ChangeHandler &after)
+{
+    QHash<QString, int> rows;
+    for (size_t i = 0; i < current.size(); ++i)
+        rows.insert(current[i].path, int(i));
+
+    removeIf([&](const EntryInfo &e) { return !rows.contains(e.path); }, before, after);
+
+    // whatever is left exists in both, upsert() would search linearly for each
+    QVector<bool> known(current.size(), false);
+    for (int row = 0; row < entries.size(); ++row)
+    {
+        const int i = rows.value(entries[row].path);
+        known[i] = true;
+        if (sameEntry(entries[row], current[i]))
+            continue;
+
+        const DirectoryChange change {DirectoryChange::Updated, row, row};
+        before(change);
+        {
+            QWriteLocker l(lock.get());
+            entries[row] = std::move(current[i]);
+        }
+        after(change);
+    }
+
+    const int first = entries.size();
+    const int added = std::count(known.begin(), known.end(), false);
+    if (added == 0)
+        return;
+
+    const DirectoryChange change {DirectoryChange::Inserted, first, first + added - 1};
+    before(change);
+    {
+        QWriteLocker l(lock.get());
+        for (size_t i = 0; i < current.size(); ++i)
+        {
+            if (!known[i])
+                entries.push_back(std::move(current[i]));
+        }
+    }
+    after(change);
+}
+
+/*
+ * lean directory which is filled by a background traversal, entries show up in
+ * the order directories are listed, see IncrementalDirectory
+ */
+class IncrementalLeanDirectory : public AdaptiveDirectory<true>, public IncrementalDirectory
+{
+public:
+    IncrementalLeanDirectory()
+    {
+        lock = std::make_unique<QReadWriteLock>();
+    }
+
+    ~IncrementalLeanDirectory()
+    {
+        // traversal refers to us, wait for it to notice
+        m_cancelled = true;
+
+        QMutexLocker locker(&m_runMutex);
+        while (m_running)
+            m_finished.wait(&m_runMutex);
+    }
+
+    // traversal stops once we are destroyed or @cancel is cancelled
+    void start(const QString &root, const CancellationToken &cancel)
+    {
+        m_running = true;
+        QThreadPool::globalInstance()->start([this, root, cancel]()
+        {
+            LeanTraversal traversal;
+            traversal.run(root, [this](std::vector<EntryInfo> &files) { append(files); }
+                          , &m_cancelled, cancel.flag());
+            m_notifier.finish();
+
+            if (watch && !m_cancelled && !cancel.isCancelled())
+                watch->setListed(traversal.directories());
+
+            QMutexLocker locker(&m_runMutex);
+            m_running = false;
+            m_finished.wakeAll();
+        });
+    }
+
+    bool isComplete() override { return m_notifier.isComplete(); }
+
+    void setProgressCallback(ProgressCallback cb) override
+    {
+        m_notifier.setCallback(this, std::move(cb));
+    }
+
+private:
+    void append(std::vector<EntryInfo> &files)
+    {
+        if (files.empty())
+            return;
+
+        {
+            QWriteLocker locker(lock.get());
+            for (auto &f : files)
+                entries.push_back(std::move(f));
+        }
+
+        m_notifier.entriesAdded();
+    }
+
+    IncrementalNotifier m_notifier;
+    std::atomic<bool> m_cancelled {false};
+
+    QMutex m_runMutex;
+    QWaitCondition m_finished;
+    bool m_running = false;
+};
+
+// returns directories which were listed
+QStringList addFiles(const QString &path, bool flatMode, RegularDirectory *dir, const std::atomic<bool> *cancelled)
+{
+    if (flatMode)
+    {
+        LeanTraversal traversal;
+        traversal.run(path, dir->entries, cancelled);
+        return traversal.directories();
+    }
+
+    DirListing listing;
+    listDir(path, flatMode, listing, cancelled);
+
+    dir->entries.reserve(listing.files.size());
+    for (auto &f : listing.files)
+        dir->entries.push_back(std::move(f));
+
+    return {dir->directoryPath};
 }
 
-std::unique_ptr<Directory> openDir(const QString &path, const bool flatMode)
+std::unique_ptr<Directory> openDir(const QString &path
+                                   , const bool flatMode
+                                   , const bool incremental = false
+                                   , const bool watch = false
+                                   , const CancellationToken &cancel = {})
 {
     QDir d(path);
     if (!d.exists())
         return {};
 
-    QFileInfoList list = d.entryInfoList();
+    if (flatMode && incremental)
+    {
+        if (cancel.isCancelled())
+            return {};
+
+        auto r = std::make_unique<IncrementalLeanDirectory>();
+        r->directoryPath = d.absolutePath();
+        r->directoryName = d.dirName();
+        if (watch)
+            r->watch = std::make_unique<DirectoryWatch>(r->directoryPath, true);
+
+        r->start(path, cancel);
+        return std::move(r);
+    }
+
     std::unique_ptr<RegularDirectory> r;
     if  (flatMode)
         r = std::make_unique<AdaptiveDirectory<true>>();
@@ -120,38 +1050,63 @@ std::unique_ptr<Directory> openDir(const QString &path, const bool flatMode)
     r->directoryPath = d.absolutePath();
     r->directoryName = d.dirName();
 
-    addFiles(path, flatMode, r.get());
+    const auto dirs = addFiles(path, flatMode, r.get(), cancel.flag());
+    if (cancel.isCancelled())
+        return {};
+
+    if (watch)
+    {
+        r->lock = std::make_unique<QReadWriteLock>();
+        r->watch = std::make_unique<DirectoryWatch>(r->directoryPath, flatMode);
+        r->watch->setListed(dirs);
+    }
+
     return std::move(r);
 }
 
 }
 
-std::unique_ptr<Directory> FileSystem::leanOpen(const QString &path)
+void FileSystem::setIncrementalOpen(bool incremental)
 {
-    return openDir(path, true);
+    m_incremental = incremental;
 }
 
-std::unique_ptr<Directory> FileSystem::open(const QString &path)
+void FileSystem::setWatchChanges(bool watch)
 {
-    return openDir(path, false);
+    m_watch = watch;
 }
 
-std::unique_ptr<Directory> FileSystem::open(const QUrl &url)
+bool FileSystem::isLeanUrl(const QUrl &url)
+{
+    return url.scheme() == LEAN_URL_SCEHEME;
+}
+
+std::unique_ptr<Directory> FileSystem::leanOpen(const QString &path, const CancellationToken &cancel)
+{
+    return openDir(path, true, m_incremental, m_watch, cancel);
+}
+
+std::unique_ptr<Directory> FileSystem::open(const QString &path, const CancellationToken &cancel)
+{
+    return openDir(path, false, false, m_watch, cancel);
+}
+
+std::unique_ptr<Directory> FileSystem::open(const QUrl &url, const CancellationToken &cancel)
 {
     if (url.scheme() == LEAN_URL_SCEHEME)
-        return openDir(url.path(), true);
+        return openDir(url.path(), true, m_incremental, m_watch, cancel);
 
     // check before otherwise toLocalFile returns empty path
     // and we search current directory
     if (!url.isLocalFile())
         return {};
 
-    return open(url.toLocalFile());
+    return open(url.toLocalFile(), cancel);
 }
 
-std::unique_ptr<Directory> FileSystem::open(Directory *dir, int child)
+std::unique_ptr<Directory> FileSystem::open(Directory *dir, int child, const CancellationToken &cancel)
 {
-    return open(dir->filePath(child));
+    return open(dir->filePath(child), cancel);
 }
 
 std::unique_ptr<Directory> FileSystem::dirParent(Directory *dir)
@@ -163,7 +1118,20 @@ std::unique_ptr<Directory> FileSystem::dirParent(Directory *dir)
     return nullptr;
 }
 
-std::unique_ptr<IOSource> FileSystem::iosource(Directory *dir, int child)
+std::unique_ptr<IOSource> FileSystem::iosource(Directory *dir, int child, const CancellationToken &)
 {
     return std::make_unique<RegularIOSource>(dir->filePath(child));
 }
+
+QByteArray FileSystem::version(const QUrl &url)
+{
+    if (!url.isLocalFile())
+        return {};
+
+    // creating, removing or renaming an entry updates directory's modification time
+    const QFileInfo info(url.toLocalFile());
+    if (!info.isDir())
+        return {};
+
+    return QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+}
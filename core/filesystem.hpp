@@ -2,6 +2,7 @@
 #define FILESYSTEM_HPP
 
 #include "directorysystem.hpp"
+#include <atomic>
 #include <memory>
 
 class QUrl;
@@ -9,15 +10,32 @@ class QUrl;
 class FileSystem : public DirectorySystem
 {
 public:
-    std::unique_ptr<Directory> leanOpen(const QString &path);
+    // lean directories are returned while they are still being traversed,
+    // see IncrementalDirectory
+    void setIncrementalOpen(bool incremental);
 
-    std::unique_ptr<Directory> open(const QString &path) override;
-    std::unique_ptr<Directory> open(const QUrl &url) override;
-    std::unique_ptr<Directory> open(Directory *dir, int child) override;
+    // directories follow changes on disk, see WatchedDirectory
+    void setWatchChanges(bool watch);
+
+    std::unique_ptr<Directory> leanOpen(const QString &path, const CancellationToken &cancel = {});
+
+    // url of a lean directory, see Directory::isLinearDir
+    static bool isLeanUrl(const QUrl &url);
+
+    std::unique_ptr<Directory> open(const QString &path, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(const QUrl &url, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(Directory *dir, int child, const CancellationToken &cancel = {}) override;
 
     std::unique_ptr<Directory> dirParent(Directory *dir) override;
 
-    std::unique_ptr<IOSource> iosource(Directory *dir, int child) override;
+    std::unique_ptr<IOSource> iosource(Directory *dir, int child, const CancellationToken &cancel = {}) override;
+
+    // only known for regular directories, lean directories span many directories
+    QByteArray version(const QUrl &url) override;
+
+private:
+    std::atomic<bool> m_incremental {false};
+    std::atomic<bool> m_watch {false};
 };
 
 #endif // FILESYSTEM_HPP
@@ -7,10 +7,21 @@
 #include <QDir>
 
 HybridDirSystem::HybridDirSystem()
-    : m_filesystem (new FileSystem), m_archivesystem (new ArchiveSystem) , m_systems { m_filesystem.get(), m_archivesystem.get() }
+    : m_filesystem (new FileSystem), m_archivesystem (new ArchiveSystem)
 {
 }
 
+void HybridDirSystem::setIncrementalOpen(bool incremental)
+{
+    m_filesystem->setIncrementalOpen(incremental);
+    m_archivesystem->setIncrementalOpen(incremental);
+}
+
+void HybridDirSystem::setWatchChanges(bool watch)
+{
+    m_filesystem->setWatchChanges(watch);
+}
+
 bool HybridDirSystem::canLinearizeDir(const QString &path)
 {
     return QDir(path).exists();
@@ -18,39 +29,72 @@ bool HybridDirSystem::canLinearizeDir(const QString &path)
 
 HybridDirSystem::~HybridDirSystem() = default;
 
-std::unique_ptr<Directory> HybridDirSystem::leanOpenDir(const QString &path)
+std::unique_ptr<Directory> HybridDirSystem::leanOpenDir(const QString &path, const CancellationToken &cancel)
 {
-    auto r = m_filesystem->leanOpen(path);
-    if (!r) return nullptr;
-
-    updatesource(r.get(), m_filesystem.get());
-    return r;
+    return m_filesystem->leanOpen(path, cancel);
 }
 
-std::unique_ptr<Directory> HybridDirSystem::open(const QString &path)
+std::unique_ptr<Directory> HybridDirSystem::open(const QString &path, const CancellationToken &cancel)
 {
-    return call([path](DirectorySystem *system)
+    return routed(path, cancel, [&](const TargetClassifier::Classification &target) -> std::unique_ptr<Directory>
     {
-        return system->open(path);
+        switch (target.target)
+        {
+        case TargetClassifier::Target::Directory:
+            return m_filesystem->open(path, cancel);
+        case TargetClassifier::Target::Archive:
+        case TargetClassifier::Target::InsideArchive:
+            return m_archivesystem->openArchivePath(target.archivePath, target.innerPath, cancel);
+        case TargetClassifier::Target::Missing:
+        case TargetClassifier::Target::Unsupported:
+            break;
+        }
+
+        return nullptr;
     });
 }
 
-std::unique_ptr<Directory> HybridDirSystem::open(const QUrl &url)
+std::unique_ptr<Directory> HybridDirSystem::open(const QUrl &url, const CancellationToken &cancel)
 {
-    return call([url](DirectorySystem *system)
+    if (ArchiveSystem::isArchiveUrl(url))
+        return m_archivesystem->open(url, cancel);
+
+    if (FileSystem::isLeanUrl(url))
+        return m_filesystem->open(url, cancel);
+
+    if (!url.isLocalFile())
+        return nullptr;
+
+    return routed(url.toLocalFile(), cancel, [&](const TargetClassifier::Classification &target) -> std::unique_ptr<Directory>
     {
-        return system->open(url);
+        switch (target.target)
+        {
+        case TargetClassifier::Target::Directory:
+            return m_filesystem->open(url, cancel);
+        case TargetClassifier::Target::Archive:
+            return m_archivesystem->open(url, cancel);
+        case TargetClassifier::Target::InsideArchive:
+            return m_archivesystem->openArchivePath(target.archivePath, target.innerPath, cancel);
+        case TargetClassifier::Target::Missing:
+        case TargetClassifier::Target::Unsupported:
+            break;
+        }
+
+        return nullptr;
     });
 }
 
-std::unique_ptr<Directory> HybridDirSystem::open(Directory *dir, int child)
+std::unique_ptr<Directory> HybridDirSystem::open(Directory *dir, int child, const CancellationToken &cancel)
 {
-    auto try1 = call(dir, [dir, child](DirectorySystem *system)
+    auto try1 = call(dir, [dir, child, &cancel](DirectorySystem *system)
     {
-        return system->open(dir, child);
+        return system->open(dir, child, cancel);
     });
 
-    return try1 ? std::move(try1) : open(dir->fileUrl(child));
+    if (try1 || cancel.isCancelled())
+        return try1;
+
+    return open(dir->fileUrl(child), cancel);
 }
 
 std::unique_ptr<Directory> HybridDirSystem::dirParent(Directory *dir)
@@ -70,38 +114,84 @@ std::unique_ptr<Directory> HybridDirSystem::dirParent(Directory *dir)
     return nullptr;
 }
 
-std::unique_ptr<IOSource> HybridDirSystem::iosource(Directory *dir, int child)
+std::unique_ptr<IOSource> HybridDirSystem::iosource(Directory *dir, int child, const CancellationToken &cancel)
 {
     if (auto system = source(dir))
     {
-        return system->iosource(dir, child);
+        return system->iosource(dir, child, cancel);
     }
 
     return nullptr;
 }
 
-std::unique_ptr<IODevice> HybridDirSystem::iodevice(Directory *dir, int child)
+std::unique_ptr<IODevice> HybridDirSystem::iodevice(Directory *dir, int child, const CancellationToken &cancel)
 {
     if (auto system = source(dir)) {
-        return system->iodevice(dir, child);
+        return system->iodevice(dir, child, cancel);
     }
 
     return nullptr;
 }
 
-void HybridDirSystem::updatesource(Directory *dir, DirectorySystem *source)
+QByteArray HybridDirSystem::version(const QUrl &url)
 {
-    assert(dir);
+    if (ArchiveSystem::isArchiveUrl(url))
+        return m_archivesystem->version(url);
+
+    if (!url.isLocalFile())
+        return m_filesystem->version(url);
+
+    const auto target = m_classifier.classify(url.toLocalFile());
+    switch (target.target)
+    {
+    case TargetClassifier::Target::Directory:
+        return m_filesystem->version(url);
+    case TargetClassifier::Target::Archive:
+    case TargetClassifier::Target::InsideArchive:
+        return m_archivesystem->version(QUrl::fromLocalFile(target.archivePath));
+    case TargetClassifier::Target::Missing:
+    case TargetClassifier::Target::Unsupported:
+        break;
+    }
 
-    QWriteLocker l(&m_lock);
-    m_sources[dir] = source;
+    return {};
 }
 
-DirectorySystem *HybridDirSystem::source(Directory *dir)
+std::unique_ptr<Directory> HybridDirSystem::routed(const QString &path
+                                                   , const CancellationToken &cancel
+                                                   , const std::function<std::unique_ptr<Directory> (const TargetClassifier::Classification &)> &open)
 {
-    assert(dir);
+    const auto target = m_classifier.classify(path);
+    if (target.target == TargetClassifier::Target::Missing)
+        return nullptr;
+
+    auto r = open(target);
+    if (r || cancel.isCancelled())
+        return r;
 
-    QReadLocker l(&m_lock);
-    return m_sources.value(dir);
+    // remembered classification may be stale, path could have been replaced on disk
+    m_classifier.forget(path);
+
+    const auto fresh = m_classifier.classify(path);
+    if (fresh.target == target.target && fresh.archivePath == target.archivePath)
+        return nullptr;
+
+    return open(fresh);
 }
 
+DirectorySystem *HybridDirSystem::source(Directory *dir) const
+{
+    assert(dir);
+
+    switch (dir->type())
+    {
+    case DirectoryType::FileSystem:
+        return m_filesystem.get();
+    case DirectoryType::Archive:
+        return m_archivesystem.get();
+    case DirectoryType::Other:
+        break;
+    }
+
+    return nullptr;
+}
@@ -2,9 +2,7 @@
 #define MULTIDIRSYSTEM_HPP
 
 #include "directorysystem.hpp"
-
-#include <QReadWriteLock>
-#include <QHash>
+#include "targetclassifier.hpp"
 
 class FileSystem;
 class ArchiveSystem;
@@ -19,57 +17,47 @@ public:
 
     // DirectorySystem interface
 public:
+    // see IncrementalDirectory
+    void setIncrementalOpen(bool incremental);
+
+    // see WatchedDirectory
+    void setWatchChanges(bool watch);
+
     bool canLinearizeDir(const QString &path);
-    std::unique_ptr<Directory> leanOpenDir(const QString &path);
+    std::unique_ptr<Directory> leanOpenDir(const QString &path, const CancellationToken &cancel = {});
 
-    std::unique_ptr<Directory> open(const QString &path) override;
-    std::unique_ptr<Directory> open(const QUrl &url) override;
-    std::unique_ptr<Directory> open(Directory *dir, int child) override;
+    std::unique_ptr<Directory> open(const QString &path, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(const QUrl &url, const CancellationToken &cancel = {}) override;
+    std::unique_ptr<Directory> open(Directory *dir, int child, const CancellationToken &cancel = {}) override;
 
     std::unique_ptr<Directory> dirParent(Directory *dir) override;
 
-    std::unique_ptr<IOSource> iosource(Directory *dir, int child) override;
+    std::unique_ptr<IOSource> iosource(Directory *dir, int child, const CancellationToken &cancel = {}) override;
 
-    std::unique_ptr<IODevice> iodevice(Directory *dir, int child) override;
-
-private:
-    std::unique_ptr<Directory> call(std::function<std::unique_ptr<Directory>(DirectorySystem *)> functor)
-    {
-        for (auto source : std::as_const(m_systems))
-        {
-            auto r = functor(source);
-            if (!r) continue;
+    std::unique_ptr<IODevice> iodevice(Directory *dir, int child, const CancellationToken &cancel = {}) override;
 
-            updatesource(r.get(), source);
-            return r;
-        }
+    QByteArray version(const QUrl &url) override;
 
-        return nullptr;
-    }
+private:
+    // opens local @path with the system its classification points to
+    std::unique_ptr<Directory> routed(const QString &path
+                                      , const CancellationToken &cancel
+                                      , const std::function<std::unique_ptr<Directory> (const TargetClassifier::Classification &)> &open);
 
     std::unique_ptr<Directory> call(Directory *dir, std::function<std::unique_ptr<Directory>(DirectorySystem *)> functor)
     {
         if (auto system = source(dir))
-        {
-            auto r = functor(system);
-            if (!r) return nullptr;
-
-            updatesource(r.get(), system);
-            return r;
-        }
+            return functor(system);
 
         return nullptr;
     }
 
-    void updatesource(Directory * dir, DirectorySystem *source);
-    DirectorySystem *source(Directory *dir);
+    // system which returned @dir, null for directories of other systems
+    DirectorySystem *source(Directory *dir) const;
 
     std::unique_ptr<FileSystem> m_filesystem;
     std::unique_ptr<ArchiveSystem> m_archivesystem;
-    std::array<DirectorySystem *, 2> m_systems;
-
-    QReadWriteLock m_lock;
-    QHash<Directory *, DirectorySystem *> m_sources;
+    TargetClassifier m_classifier;
 };
 
 #endif // MULTIDIRSYSTEM_HPP
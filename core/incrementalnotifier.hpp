@@ -0,0 +1,65 @@
+#ifndef INCREMENTALNOTIFIER_HPP
+#define INCREMENTALNOTIFIER_HPP
+
+#include "directorysystem.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+
+#include <atomic>
+
+// progress bookkeeping for IncrementalDirectory implementations, batches are
+// reported at most once per NOTIFY_INTERVAL so consumers aren't flooded
+class IncrementalNotifier
+{
+public:
+    static constexpr qint64 NOTIFY_INTERVAL = 50; // msecs
+
+    bool isComplete() const { return m_complete.load(std::memory_order_acquire); }
+
+    // callbacks are kept per observing directory, null @cb removes it
+    void setCallback(const void *owner, IncrementalDirectory::ProgressCallback cb)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (cb)
+            m_callbacks.insert(owner, std::move(cb));
+        else
+            m_callbacks.remove(owner);
+    }
+
+    // call after entries are appended
+    void entriesAdded()
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_timer.isValid() && m_timer.elapsed() < NOTIFY_INTERVAL)
+            return;
+
+        m_timer.start();
+        notify();
+    }
+
+    // call once no more entries will be appended
+    void finish()
+    {
+        m_complete.store(true, std::memory_order_release);
+
+        QMutexLocker locker(&m_mutex);
+        notify();
+    }
+
+private:
+    // callbacks run with m_mutex held, so setCallback() can't return while one is running
+    void notify()
+    {
+        for (const auto &cb : std::as_const(m_callbacks))
+            cb();
+    }
+
+    QMutex m_mutex;
+    QElapsedTimer m_timer;
+    QHash<const void *, IncrementalDirectory::ProgressCallback> m_callbacks;
+    std::atomic<bool> m_complete {false};
+};
+
+#endif // INCREMENTALNOTIFIER_HPP
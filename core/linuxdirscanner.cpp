@@ -0,0 +1,171 @@
+#include "linuxdirscanner.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+// batches larger than this are stat-ed from multiple threads, helps with
+// network mounts where each statx is a round trip
+constexpr size_t PARALLEL_STAT_THRESHOLD = 2048;
+constexpr unsigned MAX_STAT_THREADS = 8;
+
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+bool isCancelled(const std::atomic<bool> *cancelled)
+{
+    return cancelled && cancelled->load(std::memory_order_relaxed);
+}
+
+int64_t toMSecs(const struct statx_timestamp &t)
+{
+    return int64_t(t.tv_sec) * 1000 + t.tv_nsec / 1000000;
+}
+
+// returns false for entries QDir would skip (i.e. broken symlinks)
+bool statEntry(int dirfd, DirScanEntry &entry)
+{
+    struct statx st;
+    const unsigned mask = STATX_TYPE | STATX_SIZE | STATX_ATIME | STATX_MTIME | STATX_BTIME;
+
+    // follow symlinks, same as QFileInfo
+    if (statx(dirfd, entry.name.c_str(), AT_NO_AUTOMOUNT, mask, &st) != 0)
+        return false;
+
+    entry.isdir = S_ISDIR(st.stx_mode);
+    entry.size = int64_t(st.stx_size);
+    entry.lastAccessTime = (st.stx_mask & STATX_ATIME) ? toMSecs(st.stx_atime) : 0;
+    entry.creationTime = (st.stx_mask & STATX_BTIME) ? toMSecs(st.stx_btime) : 0;
+    entry.modifiedTime = (st.stx_mask & STATX_MTIME) ? toMSecs(st.stx_mtime) : 0;
+    return true;
+}
+
+void statBatch(int dirfd, std::vector<DirScanEntry *> &batch, std::vector<char> &valid
+               , const std::atomic<bool> *cancelled)
+{
+    valid.assign(batch.size(), false);
+
+    const auto statRange = [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end && !isCancelled(cancelled); ++i)
+            valid[i] = statEntry(dirfd, *batch[i]);
+    };
+
+    const unsigned threads = std::min(MAX_STAT_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    if (batch.size() < PARALLEL_STAT_THRESHOLD || threads == 1)
+    {
+        statRange(0, batch.size());
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    const size_t step = (batch.size() + threads - 1) / threads;
+    for (size_t begin = 0; begin < batch.size(); begin += step)
+        workers.emplace_back(statRange, begin, std::min(batch.size(), begin + step));
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+}
+
+bool scanDirectory(const std::string &path, bool statDirs, std::vector<DirScanEntry> &entries
+                   , const std::atomic<bool> *cancelled)
+{
+    const int dirfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        return false;
+
+    const size_t firstEntry = entries.size();
+
+    // entries whose type or metadata is only available through statx
+    std::vector<size_t> pending;
+
+    alignas(linux_dirent64) char buf[64 * 1024];
+    while (true)
+    {
+        const long nread = syscall(SYS_getdents64, dirfd, buf, sizeof(buf));
+        if (nread < 0 || isCancelled(cancelled))
+        {
+            close(dirfd);
+            entries.resize(firstEntry);
+            return false;
+        }
+
+        if (nread == 0)
+            break;
+
+        for (long offset = 0; offset < nread;)
+        {
+            const auto *d = reinterpret_cast<const linux_dirent64 *>(buf + offset);
+            offset += d->d_reclen;
+
+            // skips '.', '..' and hidden files
+            if (d->d_name[0] == '.')
+                continue;
+
+            DirScanEntry entry;
+            entry.name = d->d_name;
+            entry.isdir = (d->d_type == DT_DIR);
+
+            const bool needStat = statDirs || d->d_type != DT_DIR;
+            if (needStat)
+                pending.push_back(entries.size());
+
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    std::vector<DirScanEntry *> batch;
+    batch.reserve(pending.size());
+    for (const size_t i : pending)
+        batch.push_back(&entries[i]);
+
+    std::vector<char> valid;
+    statBatch(dirfd, batch, valid, cancelled);
+    close(dirfd);
+
+    if (isCancelled(cancelled))
+    {
+        entries.resize(firstEntry);
+        return false;
+    }
+
+    // drop entries that failed to stat
+    if (std::find(valid.begin(), valid.end(), false) != valid.end())
+    {
+        std::vector<char> keep(entries.size() - firstEntry, true);
+        for (size_t i = 0; i < pending.size(); ++i)
+            keep[pending[i] - firstEntry] = valid[i];
+
+        size_t out = firstEntry;
+        for (size_t i = firstEntry; i < entries.size(); ++i)
+        {
+            if (!keep[i - firstEntry])
+                continue;
+
+            if (out != i)
+                entries[out] = std::move(entries[i]);
+
+            ++out;
+        }
+
+        entries.resize(out);
+    }
+
+    return true;
+}
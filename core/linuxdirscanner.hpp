@@ -0,0 +1,36 @@
+#ifndef LINUXDIRSCANNER_HPP
+#define LINUXDIRSCANNER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// directory listing for linux, reads entries with getdents64 and then stats
+// them in a batch with statx, relative to the directory fd
+
+struct DirScanEntry
+{
+    std::string name;
+    int64_t size = 0;
+
+    // msecs since epoch, 0 if not available
+    int64_t lastAccessTime = 0;
+    int64_t creationTime = 0;
+    int64_t modifiedTime = 0;
+
+    bool isdir = false;
+};
+
+/*
+ * list @path skipping '.', '..' and hidden entries (like QDir's default filter)
+ *
+ * if @statDirs is false, directories known from d_type are not stat-ed and only have
+ * name and isdir set, useful when caller is only going to recurse into them
+ *
+ * returns false if directory can't be read or once @cancelled is set
+ */
+bool scanDirectory(const std::string &path, bool statDirs, std::vector<DirScanEntry> &entries
+                   , const std::atomic<bool> *cancelled = nullptr);
+
+#endif // LINUXDIRSCANNER_HPP
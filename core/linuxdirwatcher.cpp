@@ -0,0 +1,179 @@
+#include "linuxdirwatcher.hpp"
+
+#include <cerrno>
+#include <cstdint>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace
+{
+
+// IN_MODIFY is left out on purpose, files being downloaded would flood us,
+// IN_CLOSE_WRITE reports them once they're done
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+}
+
+LinuxDirWatcher::LinuxDirWatcher(Callback callback)
+    : m_callback {std::move(callback)}
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_fd < 0 || m_stopFd < 0)
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+        if (m_stopFd >= 0)
+            close(m_stopFd);
+
+        m_fd = m_stopFd = -1;
+        return;
+    }
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+LinuxDirWatcher::~LinuxDirWatcher()
+{
+    if (m_thread.joinable())
+    {
+        const uint64_t one = 1;
+        [[maybe_unused]] auto r = write(m_stopFd, &one, sizeof(one));
+        m_thread.join();
+    }
+
+    if (m_fd >= 0)
+        close(m_fd);
+    if (m_stopFd >= 0)
+        close(m_stopFd);
+}
+
+bool LinuxDirWatcher::isValid() const
+{
+    return m_fd >= 0;
+}
+
+bool LinuxDirWatcher::addWatch(const std::string &dir)
+{
+    if (m_fd < 0)
+        return false;
+
+    const int wd = inotify_add_watch(m_fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paths[wd] = dir;
+    m_watches[dir] = wd;
+    return true;
+}
+
+void LinuxDirWatcher::removeWatch(const std::string &dir)
+{
+    const std::string prefix = dir + '/';
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_watches.begin(); it != m_watches.end();)
+    {
+        if (it->first != dir && it->first.compare(0, prefix.size(), prefix) != 0)
+        {
+            ++it;
+            continue;
+        }
+
+        inotify_rm_watch(m_fd, it->second);
+        m_paths.erase(it->second);
+        it = m_watches.erase(it);
+    }
+}
+
+size_t LinuxDirWatcher::watchCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_watches.size();
+}
+
+void LinuxDirWatcher::run()
+{
+    pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+    alignas(inotify_event) char buf[READ_BUFFER_SIZE];
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return;
+        }
+
+        if (fds[1].revents)
+            return;
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        ssize_t len;
+        while ((len = read(m_fd, buf, sizeof(buf))) > 0)
+            dispatch(buf, size_t(len));
+    }
+}
+
+void LinuxDirWatcher::dispatch(const char *buf, size_t len)
+{
+    for (const char *p = buf; p < buf + len;)
+    {
+        const auto event = reinterpret_cast<const inotify_event *>(p);
+        p += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            m_callback(Event::Overflow, {}, false);
+            continue;
+        }
+
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto it = m_paths.find(event->wd);
+            if (it == m_paths.end())
+                continue;
+
+            dir = it->second;
+
+            // watch is gone, directory was deleted or watch was removed
+            if (event->mask & IN_IGNORED)
+            {
+                const auto watch = m_watches.find(dir);
+                if (watch != m_watches.end() && watch->second == event->wd)
+                    m_watches.erase(watch);
+
+                m_paths.erase(it);
+                continue;
+            }
+        }
+
+        // events of watched directory itself are reported by its parent
+        if (event->len == 0 || event->name[0] == '.')
+            continue;
+
+        const std::string path = (!dir.empty() && dir.back() == '/')
+                                     ? dir + event->name
+                                     : dir + '/' + event->name;
+        const bool isdir = event->mask & IN_ISDIR;
+
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            m_callback(Event::Created, path, isdir);
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            m_callback(Event::Removed, path, isdir);
+        else if (event->mask & (IN_CLOSE_WRITE | IN_ATTRIB))
+            m_callback(Event::Modified, path, isdir);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef LINUXDIRWATCHER_HPP
+#define LINUXDIRWATCHER_HPP
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// watches directories for changes with inotify, events are reported from a
+// background thread, sub directories are not watched unless added explicitly
+
+class LinuxDirWatcher
+{
+public:
+    enum class Event
+    {
+        Created,  // also moved into a watched directory
+        Removed,  // also moved out of a watched directory
+        Modified, // closed after writing or attributes changed
+        Overflow  // events were dropped, watched directories should be rescanned
+    };
+
+    // @path is the full path of the affected entry, empty for Overflow,
+    // hidden entries are not reported (like QDir's default filter)
+    using Callback = std::function<void (Event event, const std::string &path, bool isdir)>;
+
+    explicit LinuxDirWatcher(Callback callback);
+    ~LinuxDirWatcher();
+
+    LinuxDirWatcher(const LinuxDirWatcher &) = delete;
+    LinuxDirWatcher &operator=(const LinuxDirWatcher &) = delete;
+
+    // false if inotify is not available
+    bool isValid() const;
+
+    // returns false if @dir can't be watched, i.e. user's watch limit is reached
+    bool addWatch(const std::string &dir);
+
+    // removes watches of @dir and directories below it
+    void removeWatch(const std::string &dir);
+
+    size_t watchCount() const;
+
+private:
+    void run();
+    void dispatch(const char *buf, size_t len);
+
+    Callback m_callback;
+    int m_fd = -1;
+    int m_stopFd = -1;
+    std::thread m_thread;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<int, std::string> m_paths;   // wd -> dir
+    std::unordered_map<std::string, int> m_watches; // dir -> wd
+};
+
+#endif // LINUXDIRWATCHER_HPP
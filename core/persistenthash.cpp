@@ -72,6 +72,57 @@ bool PersistentHashBase::storeData(const QString &key, const QByteArray &value)
     return true;
 }
 
+bool PersistentHashBase::storeData(const QList<std::pair<QString, QByteArray>> &values)
+{
+    if (!m_db->transaction()) {
+        setLastError(m_db->lastError());
+        qCritical() << "Failed to start transaction:" << m_lastError;
+        return false;
+    }
+
+    QSqlQuery query(*m_db);
+    query.prepare("INSERT OR REPLACE INTO hash_data (key, value) VALUES (?, ?)");
+
+    for (const auto &[key, value] : values) {
+        query.bindValue(0, key);
+        query.bindValue(1, value);
+
+        if (!query.exec()) {
+            setLastError(query.lastError());
+            qCritical() << "Failed to insert data:" << m_lastError;
+
+            m_db->rollback();
+            return false;
+        }
+    }
+
+    if (!m_db->commit()) {
+        setLastError(m_db->lastError());
+        qCritical() << "Failed to commit data:" << m_lastError;
+        return false;
+    }
+
+    return true;
+}
+
+QList<std::pair<QString, QByteArray>> PersistentHashBase::retrieveAll() const
+{
+    QList<std::pair<QString, QByteArray>> values;
+
+    QSqlQuery query(*m_db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT key, value FROM hash_data")) {
+        const_cast<PersistentHashBase*>(this)->setLastError(query.lastError());
+        return values;
+    }
+
+    while (query.next()) {
+        values.push_back({query.value(0).toString(), query.value(1).toByteArray()});
+    }
+
+    return values;
+}
+
 bool PersistentHashBase::retrieveData(const QString &key, QByteArray &value) const
 {
     QSqlQuery query(*m_db);
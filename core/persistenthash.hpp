@@ -6,7 +6,12 @@
 #include <QStringList>
 #include <QDataStream>
 #include <QByteArray>
+#include <QHash>
 #include <QIODevice>
+#include <QList>
+
+#include <memory>
+#include <utility>
 
 // Forward declarations
 class QSqlError;
@@ -31,6 +36,10 @@ protected:
     // Protected methods for derived template class
     bool storeData(const QString &key, const QByteArray &value);
     bool retrieveData(const QString &key, QByteArray &value) const;
+
+    // all values are stored in one transaction
+    bool storeData(const QList<std::pair<QString, QByteArray>> &values);
+    QList<std::pair<QString, QByteArray>> retrieveAll() const;
     bool isOpen() const;
 
 private:
@@ -62,16 +71,24 @@ public:
             return false;
         }
 
-        // Serialize the value to a QByteArray
-        QByteArray byteArray;
-        {
-            QDataStream stream(&byteArray, QIODevice::WriteOnly);
-            stream << value;
+        // Use the base class method to store the data
+        return storeData(key, serialize(value));
+    }
+
+    // Insert or update all pairs of @values in one transaction
+    bool insert(const QHash<QString, T> &values)
+    {
+        if (!isOpen()) {
+            return false;
         }
 
-        qDebug() << "insert" << key << value.row << value.col;
-        // Use the base class method to store the data
-        return storeData(key, byteArray);
+        QList<std::pair<QString, QByteArray>> data;
+        data.reserve(values.size());
+        for (auto it = values.cbegin(); it != values.cend(); ++it) {
+            data.push_back({it.key(), serialize(it.value())});
+        }
+
+        return storeData(data);
     }
 
     // Retrieve a value by key
@@ -90,7 +107,6 @@ public:
         QDataStream stream(&byteArray, QIODevice::ReadOnly);
         stream >> result;
 
-        qDebug() << "value" << key << result.row << result.col;
         return stream.status() == QDataStream::Ok;
     }
 
@@ -100,6 +116,38 @@ public:
         value(key, result);
         return result;
     }
+
+    // Retrieve all pairs with one query
+    QHash<QString, T> values() const
+    {
+        QHash<QString, T> result;
+        if (!isOpen()) {
+            return result;
+        }
+
+        const auto data = retrieveAll();
+        result.reserve(data.size());
+        for (const auto &[key, byteArray] : data) {
+            QDataStream stream(byteArray);
+
+            T value;
+            stream >> value;
+            if (stream.status() == QDataStream::Ok) {
+                result.insert(key, std::move(value));
+            }
+        }
+
+        return result;
+    }
+
+private:
+    static QByteArray serialize(const T &value)
+    {
+        QByteArray byteArray;
+        QDataStream stream(&byteArray, QIODevice::WriteOnly);
+        stream << value;
+        return byteArray;
+    }
 };
 
 #endif // PERSISTENTHASH_H
@@ -0,0 +1,144 @@
+#include "targetclassifier.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+
+// formats libarchive reads, checked before sniffing the content
+const char *const ARCHIVE_SUFFIXES[] = {
+    ".7z", ".7zip", ".a", ".apk", ".arj", ".bz2", ".cab", ".cpio", ".gz", ".iso",
+    ".jar", ".lz4", ".lzma", ".rar", ".tar", ".tbz", ".tgz", ".tlz", ".txz",
+    ".war", ".xz", ".z", ".zip"
+};
+
+struct Magic
+{
+    qint64 offset;
+    QByteArrayView bytes;
+};
+
+const Magic ARCHIVE_MAGICS[] = {
+    {0, "PK\x03\x04"},                       // zip
+    {0, "PK\x05\x06"},                       // empty zip
+    {0, "Rar!\x1a\x07"},                     // rar
+    {0, "7z\xbc\xaf\x27\x1c"},               // 7z
+    {0, "\x1f\x8b"},                         // gzip
+    {0, "BZh"},                              // bzip2
+    {0, QByteArrayView("\xfd" "7zXZ\x00", 6)}, // xz
+    {0, "\x28\xb5\x2f\xfd"},                 // zstd
+    {0, "\x04\x22\x4d\x18"},                 // lz4
+    {0, "MSCF"},                             // cab
+    {0, "!<arch>\n"},                        // ar
+    {0, "070707"},                           // cpio
+    {0, "07070"},                            // cpio (newc, crc)
+    {257, "ustar"},                          // tar
+    {32769, "CD001"},                        // iso9660
+};
+
+// enough for all of above
+constexpr qint64 MAGIC_READ_SIZE = 32769 + 5;
+
+}
+
+TargetClassifier::Classification TargetClassifier::classify(const QString &path)
+{
+    const QString key = QDir::cleanPath(QDir(path).absolutePath());
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const auto cached = m_cache.object(key))
+            return *cached;
+    }
+
+    const auto result = classifyUncached(key);
+
+    // missing paths may show up any moment, don't remember them
+    if (result.target != Target::Missing)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cache.insert(key, new Classification(result));
+    }
+
+    return result;
+}
+
+void TargetClassifier::forget(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(QDir::cleanPath(QDir(path).absolutePath()));
+}
+
+bool TargetClassifier::hasArchiveSuffix(const QString &path)
+{
+    return std::any_of(std::begin(ARCHIVE_SUFFIXES), std::end(ARCHIVE_SUFFIXES), [&path](const char *suffix)
+    {
+        return path.endsWith(QLatin1StringView(suffix), Qt::CaseInsensitive);
+    });
+}
+
+bool TargetClassifier::hasArchiveMagic(QIODevice *device)
+{
+    // short read for small files, iso magic is far into the file
+    const QByteArray head = device->read(MAGIC_READ_SIZE);
+
+    return std::any_of(std::begin(ARCHIVE_MAGICS), std::end(ARCHIVE_MAGICS), [&head](const Magic &magic)
+    {
+        return QByteArrayView(head).sliced(std::min<qint64>(magic.offset, head.size())).startsWith(magic.bytes);
+    });
+}
+
+TargetClassifier::Classification TargetClassifier::classifyUncached(const QString &path)
+{
+    const QFileInfo info(path);
+    if (info.isDir())
+        return {Target::Directory, {}, {}};
+
+    if (info.isFile())
+    {
+        if (isArchiveFile(path))
+            return {Target::Archive, path, {}};
+
+        return {Target::Unsupported, {}, {}};
+    }
+
+    // walk up to the first existing ancestor, path continues inside it if it's an archive
+    QString archivePath = path;
+    while (true)
+    {
+        const int sep = archivePath.lastIndexOf('/');
+        if (sep <= 0)
+            return {};
+
+        archivePath.truncate(sep);
+
+        const QFileInfo ancestor(archivePath);
+        if (ancestor.isDir())
+            return {};
+
+        if (ancestor.exists())
+        {
+            if (!ancestor.isFile() || !isArchiveFile(archivePath))
+                return {};
+
+            return {Target::InsideArchive, archivePath, path.mid(archivePath.size())};
+        }
+    }
+}
+
+bool TargetClassifier::isArchiveFile(const QString &path)
+{
+    if (hasArchiveSuffix(path))
+        return true;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    return hasArchiveMagic(&file);
+}
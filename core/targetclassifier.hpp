@@ -0,0 +1,59 @@
+#ifndef TARGETCLASSIFIER_HPP
+#define TARGETCLASSIFIER_HPP
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+
+class QIODevice;
+
+/*
+ * decides once which system can open a local path, from its stat result, extension
+ * and magic bytes, so that opening doesn't have to try every system in turn
+ *
+ * recent classifications are cached, they can go stale if the path is replaced on disk,
+ * use forget() when a routed open fails
+ */
+class TargetClassifier
+{
+public:
+    static constexpr int CACHE_SIZE = 64;
+
+    enum class Target
+    {
+        Missing,       // nothing on disk
+        Unsupported,   // file which isn't an archive
+        Directory,
+        Archive,       // archive file
+        InsideArchive  // path continues inside an archive file
+    };
+
+    struct Classification
+    {
+        Target target = Target::Missing;
+
+        // set for Archive and InsideArchive
+        QString archivePath;
+
+        // set for InsideArchive, '/' separated path of the child inside archive
+        QString innerPath;
+    };
+
+    Classification classify(const QString &path);
+
+    void forget(const QString &path);
+
+    static bool hasArchiveSuffix(const QString &path);
+
+    // @device must be positioned at the start
+    static bool hasArchiveMagic(QIODevice *device);
+
+private:
+    static Classification classifyUncached(const QString &path);
+    static bool isArchiveFile(const QString &path);
+
+    QMutex m_mutex;
+    QCache<QString, Classification> m_cache {CACHE_SIZE};
+};
+
+#endif // TARGETCLASSIFIER_HPP
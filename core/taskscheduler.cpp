@@ -0,0 +1,136 @@
+#include "taskscheduler.hpp"
+
+#include <algorithm>
+
+TaskScheduler::TaskScheduler(int maxThreads)
+{
+    maxThreads = std::max(2, maxThreads);
+    m_pool.setMaxThreadCount(maxThreads);
+
+    // lower lanes never take all threads together, see nextLane(), one is always left for opens
+    m_limits[Open] = maxThreads;
+    m_limits[Preview] = std::max(1, maxThreads / 2);
+    m_limits[Prefetch] = 1;
+    m_limits[Indexing] = 1;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto &queue : m_queues)
+            queue.clear();
+    }
+
+    m_pool.waitForDone();
+}
+
+int TaskScheduler::maxThreads() const
+{
+    return m_pool.maxThreadCount();
+}
+
+void TaskScheduler::setLaneLimit(Lane lane, int limit)
+{
+    QMutexLocker locker(&m_mutex);
+    m_limits[lane] = std::max(1, limit);
+    dispatch();
+}
+
+int TaskScheduler::laneLimit(Lane lane) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_limits[lane];
+}
+
+void TaskScheduler::start(Lane lane, std::function<void ()> task)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Task t {std::move(task), {}};
+    t.queued.start();
+
+    m_queues[lane].push_back(std::move(t));
+    ++m_metrics[lane].queued;
+    dispatch();
+}
+
+TaskScheduler::LaneMetrics TaskScheduler::metrics(Lane lane) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_metrics[lane];
+}
+
+void TaskScheduler::waitForDone()
+{
+    // a finishing task dispatches the next one before its thread goes idle
+    m_pool.waitForDone();
+}
+
+void TaskScheduler::dispatch()
+{
+    while (m_running < m_pool.maxThreadCount())
+    {
+        const int next = nextLane();
+        if (next == -1)
+            return;
+
+        const auto lane = static_cast<Lane>(next);
+        Task task = std::move(m_queues[lane].front());
+        m_queues[lane].pop_front();
+
+        auto &metrics = m_metrics[lane];
+        const qint64 wait = task.queued.elapsed();
+        --metrics.queued;
+        ++metrics.running;
+        ++metrics.started;
+        metrics.totalWait += wait;
+        metrics.maxWait = std::max(metrics.maxWait, wait);
+
+        ++m_running;
+        m_pool.start([this, lane, function = std::move(task.function)]()
+        {
+            function();
+            finished(lane);
+        });
+    }
+}
+
+int TaskScheduler::nextLane() const
+{
+    int best = -1;
+    qint64 bestRank = LaneCount;
+    qint64 bestWait = -1;
+
+    const bool backgroundFull = m_running - m_metrics[Open].running >= m_pool.maxThreadCount() - 1;
+
+    for (int lane = 0; lane < LaneCount; ++lane)
+    {
+        const auto &queue = m_queues[lane];
+        if (queue.empty() || m_metrics[lane].running >= m_limits[lane])
+            continue;
+
+        if (lane != Open && backgroundFull)
+            continue;
+
+        // ties go to the task waiting longer, so an aged task gets ahead of fresh opens
+        const qint64 wait = queue.front().queued.elapsed();
+        const qint64 rank = std::max<qint64>(0, lane - wait / AGING_INTERVAL);
+        if (rank < bestRank || (rank == bestRank && wait > bestWait))
+        {
+            best = lane;
+            bestRank = rank;
+            bestWait = wait;
+        }
+    }
+
+    return best;
+}
+
+void TaskScheduler::finished(Lane lane)
+{
+    QMutexLocker locker(&m_mutex);
+    --m_running;
+    --m_metrics[lane].running;
+    dispatch();
+}
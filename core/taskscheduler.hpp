@@ -0,0 +1,118 @@
+#ifndef TASKSCHEDULER_HPP
+#define TASKSCHEDULER_HPP
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QMutex>
+#include <QPromise>
+#include <QThread>
+#include <QThreadPool>
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * runs background work in lanes of decreasing priority, so that a slow preview
+ * extraction doesn't delay opening a folder and speculative work doesn't delay either
+ *
+ * a free thread takes the front task of the most important lane that is below its
+ * concurrency limit, tasks are promoted by one lane for every AGING_INTERVAL they
+ * wait so lower lanes aren't starved, running tasks are never preempted
+ */
+class TaskScheduler
+{
+public:
+    enum Lane
+    {
+        Open,     // user initiated directory opens
+        Preview,  // current preview
+        Prefetch, // speculative opens and revalidation
+        Indexing, // background bookkeeping
+
+        LaneCount
+    };
+
+    static constexpr qint64 AGING_INTERVAL = 500; // msecs
+
+    struct LaneMetrics
+    {
+        int queued = 0;       // current queue depth
+        int running = 0;
+        qint64 started = 0;   // tasks started so far
+        qint64 totalWait = 0; // msecs spent in queue by started tasks
+        qint64 maxWait = 0;
+
+        qint64 averageWait() const { return started > 0 ? totalWait / started : 0; }
+    };
+
+    explicit TaskScheduler(int maxThreads = QThread::idealThreadCount());
+
+    // queued tasks are dropped, running ones are waited for
+    ~TaskScheduler();
+
+    int maxThreads() const;
+
+    // at most @limit tasks of @lane run at a time
+    void setLaneLimit(Lane lane, int limit);
+    int laneLimit(Lane lane) const;
+
+    void start(Lane lane, std::function<void ()> task);
+
+    // like QtConcurrent::run, future of a dropped task is cancelled
+    template <typename Function, typename ...Args>
+    auto run(Lane lane, Function &&function, Args &&...args)
+    {
+        using Result = std::invoke_result_t<std::decay_t<Function>, std::decay_t<Args>...>;
+
+        auto promise = std::make_shared<QPromise<Result>>();
+        auto future = promise->future();
+        promise->start();
+
+        start(lane, [promise
+                    , function = std::forward<Function>(function)
+                    , args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            if constexpr (std::is_void_v<Result>)
+                std::apply(function, std::move(args));
+            else
+                promise->addResult(std::apply(function, std::move(args)));
+
+            promise->finish();
+        });
+
+        return future;
+    }
+
+    LaneMetrics metrics(Lane lane) const;
+
+    // blocks till queued and running tasks are done
+    void waitForDone();
+
+private:
+    struct Task
+    {
+        std::function<void ()> function;
+        QElapsedTimer queued;
+    };
+
+    // following require m_mutex
+    void dispatch();
+    int nextLane() const;
+
+    void finished(Lane lane);
+
+    mutable QMutex m_mutex;
+    std::array<std::deque<Task>, LaneCount> m_queues;
+    std::array<int, LaneCount> m_limits;
+    std::array<LaneMetrics, LaneCount> m_metrics;
+    int m_running = 0;
+
+    // last, so that running tasks are done before rest is destroyed
+    QThreadPool m_pool;
+};
+
+#endif // TASKSCHEDULER_HPP
@@ -1,18 +1,105 @@
 #include "directoryopener.hpp"
 
 #include <QtConcurrent/QtConcurrent>
-#include <QThreadPool>
+#include <QPromise>
+#include <condition_variable>
 #include <filesystem>
+#include <mutex>
 
 #include "../core/directorysystem.hpp"
 #include "../core/hybriddirsystem.hpp"
+#include "../core/taskscheduler.hpp"
 
-DirectoryOpener::DirectoryOpener(std::shared_ptr<QThreadPool> pool, std::shared_ptr<DirectorySystem> system, QObject *parent)
+namespace
+{
+
+// snapshots kept for back/forward
+constexpr int RECENT_SNAPSHOTS = 8;
+
+// speculative opens kept for children of current directory
+constexpr int PREFETCHED_CHILDREN = 4;
+
+// older prefetched directories are reopened, they might not reflect the disk anymore
+constexpr qint64 PREFETCH_MAX_AGE = 30 * 1000; // msecs
+
+bool isComplete(Directory *dir)
+{
+    auto incremental = dynamic_cast<IncrementalDirectory *>(dir);
+    return !incremental || incremental->isComplete();
+}
+
+// blocks till an incremental directory is fully read, returns false if @cancel was cancelled first
+bool waitComplete(Directory *dir, const CancellationToken &cancel)
+{
+    auto incremental = dynamic_cast<IncrementalDirectory *>(dir);
+    if (!incremental)
+        return !cancel.isCancelled();
+
+    std::mutex mutex;
+    std::condition_variable completed;
+
+    incremental->setProgressCallback([&]()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.notify_all();
+    });
+
+    // cancellation is noticed with the next batch of entries
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        completed.wait(lock, [incremental, &cancel]()
+        {
+            return incremental->isComplete() || cancel.isCancelled();
+        });
+    }
+
+    incremental->setProgressCallback(nullptr);
+    return !cancel.isCancelled();
+}
+
+// order insensitive, incremental directories don't list entries in a fixed order
+bool sameListing(Directory *a, Directory *b)
+{
+    const int count = a->fileCount();
+    if (count != b->fileCount())
+        return false;
+
+    QHash<QString, int> index;
+    index.reserve(count);
+    for (int i = 0; i < count; ++i)
+        index.insert(a->filePath(i), i);
+
+    for (int j = 0; j < count; ++j)
+    {
+        const auto it = index.constFind(b->filePath(j));
+        if (it == index.cend())
+            return false;
+
+        const int i = it.value();
+        if (a->isDir(i) != b->isDir(j)
+            || a->fileSize(i) != b->fileSize(j)
+            || a->fileModifiedTime(i) != b->fileModifiedTime(j))
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+DirectoryOpener::DirectoryOpener(std::shared_ptr<TaskScheduler> scheduler, std::shared_ptr<DirectorySystem> system, QObject *parent)
     : QObject{parent}
-    , m_pool {pool}
+    , m_scheduler {scheduler}
     , m_system {system}
 {}
 
+DirectoryOpener::~DirectoryOpener()
+{
+    // scheduler outlives us, don't let it finish work nobody waits for
+    m_cancel.cancel();
+    clearPrefetched();
+}
+
 std::shared_ptr<Directory> DirectoryOpener::dir() const
 {
     return m_dir;
@@ -22,24 +109,91 @@ void DirectoryOpener::openUrl(const QUrl &url)
 {
     const auto open = [](
                           std::shared_ptr<DirectorySystem> system,
-                          const QUrl &url) -> std::shared_ptr<Directory>
+                          const QUrl &url,
+                          CancellationToken cancel) -> Snapshot
+    {
+        const auto version = system->version(url);
+        return snapshot(system->open(url, cancel), version);
+    };
+
+    const auto cancel = CancellationToken::create();
+    nextDir(m_scheduler->run(TaskScheduler::Open, open, m_system, url, cancel), cancel);
+}
+
+void DirectoryOpener::openRecentUrl(const QUrl &url)
+{
+    const auto it = std::find_if(m_recent.begin(), m_recent.end(), [&url](const Snapshot &snapshot)
+    {
+        return snapshot.url == url;
+    });
+
+    if (it == m_recent.end())
+    {
+        openUrl(url);
+        return;
+    }
+
+    const Snapshot snapshot = *it;
+    m_recent.move(std::distance(m_recent.begin(), it), 0);
+
+    auto requestID = ++m_currentRequest;
+    m_cancel.cancel();
+    m_cancel = CancellationToken::create();
+
+    if (m_dir != snapshot.dir)
+        clearPrefetched();
+
+    m_dir = snapshot.dir;
+    emit directoryChanged();
+
+    // returns invalid snapshot if cached one is still valid
+    const auto revalidate = [](
+                          std::shared_ptr<DirectorySystem> system,
+                          Snapshot snapshot,
+                          CancellationToken cancel) -> Snapshot
     {
-        return system->open(url);
+        // still being read, can't be more recent than this
+        if (!isComplete(snapshot.dir.get()))
+            return {};
+
+        // take version before reading, so that changes while reading aren't missed
+        const auto version = system->version(snapshot.url);
+        if (!version.isEmpty() && version == snapshot.version)
+            return {};
+
+        std::shared_ptr<Directory> fresh = system->open(snapshot.url, cancel);
+        if (!fresh || !waitComplete(fresh.get(), cancel))
+            return {};
+
+        if (sameListing(snapshot.dir.get(), fresh.get()))
+            return {};
+
+        return {snapshot.url, fresh, version};
     };
 
-    nextDir(QtConcurrent::run(m_pool.get(), open, m_system, url));
+    m_scheduler->run(TaskScheduler::Prefetch, revalidate, m_system, snapshot, m_cancel)
+        .then(this, [this, requestID](Snapshot fresh)
+    {
+        if (requestID != m_currentRequest || !fresh.dir)
+            return;
+
+        setDir(std::move(fresh));
+    });
 }
 
 void DirectoryOpener::openPath(const QString &path)
 {
     const auto open = [](
                           std::shared_ptr<DirectorySystem> system,
-                          const QString &path) -> std::shared_ptr<Directory>
+                          const QString &path,
+                          CancellationToken cancel) -> Snapshot
     {
-        return system->open(path);
+        const auto version = system->version(QUrl::fromLocalFile(path));
+        return snapshot(system->open(path, cancel), version);
     };
 
-    nextDir(QtConcurrent::run(m_pool.get(), open, m_system, path));
+    const auto cancel = CancellationToken::create();
+    nextDir(m_scheduler->run(TaskScheduler::Open, open, m_system, path, cancel), cancel);
 }
 
 void DirectoryOpener::leanOpenPath(const QString &path)
@@ -48,27 +202,102 @@ void DirectoryOpener::leanOpenPath(const QString &path)
 
     const auto open = [](
                           std::shared_ptr<HybridDirSystem> system,
-                          const QString &path) -> std::shared_ptr<Directory>
+                          const QString &path,
+                          CancellationToken cancel) -> Snapshot
     {
-        return system->leanOpenDir(path);
+        // lean directories aren't versioned
+        return snapshot(system->leanOpenDir(path, cancel), {});
     };
 
-    nextDir(QtConcurrent::run(m_pool.get(), open, system, path));
+    const auto cancel = CancellationToken::create();
+    nextDir(m_scheduler->run(TaskScheduler::Open, open, system, path, cancel), cancel);
 }
 
 void DirectoryOpener::openChild(const int child)
 {
     if (!m_dir) return;
 
+    if (auto prefetched = takePrefetched(m_dir->fileUrl(child)); prefetched.future.isValid())
+    {
+        nextDir(std::move(prefetched.future), prefetched.cancel);
+        return;
+    }
+
     const auto open = [](
                           std::shared_ptr<DirectorySystem> system,
                           std::shared_ptr<Directory> dir,
-                          int child) -> std::shared_ptr<Directory>
+                          int child,
+                          CancellationToken cancel) -> Snapshot
     {
-        return system->open(dir.get(), child);
+        const auto version = system->version(dir->fileUrl(child));
+        return snapshot(system->open(dir.get(), child, cancel), version);
     };
 
-    nextDir(QtConcurrent::run(m_pool.get(), open, m_system, m_dir, child));
+    const auto cancel = CancellationToken::create();
+    nextDir(m_scheduler->run(TaskScheduler::Open, open, m_system, m_dir, child, cancel), cancel);
+}
+
+void DirectoryOpener::prefetchChild(const int child)
+{
+    // only the highlighted child is worth speculating on
+    cancelPrefetch();
+
+    if (!m_dir || child < 0 || child >= m_dir->fileCount())
+        return;
+
+    const auto url = m_dir->fileUrl(child);
+    if (url.isEmpty())
+        return;
+
+    // single flight, entries left after cancelPrefetch() are done
+    const auto existing = std::find_if(m_prefetched.begin(), m_prefetched.end(), [&url](const Prefetch &prefetch)
+    {
+        return prefetch.url == url;
+    });
+
+    if (existing != m_prefetched.end() && existing->age.elapsed() < PREFETCH_MAX_AGE)
+        return;
+
+    m_prefetched.removeIf([&url](const Prefetch &prefetch) { return prefetch.url == url; });
+
+    auto promise = std::make_shared<QPromise<Snapshot>>();
+    auto claimed = std::make_shared<std::atomic<bool>>(false);
+    const auto cancel = CancellationToken::create();
+    promise->start();
+
+    Prefetch prefetch {url, promise->future(), claimed, cancel, {}};
+    prefetch.age.start();
+
+    const auto task = [system = m_system, dir = m_dir, child, promise, claimed, cancel]()
+    {
+        if (claimed->exchange(true))
+            return;
+
+        const auto version = system->version(dir->fileUrl(child));
+        promise->addResult(snapshot(system->open(dir.get(), child, cancel), version));
+        promise->finish();
+    };
+
+    m_prefetched.push_back(std::move(prefetch));
+    if (m_prefetched.size() > PREFETCHED_CHILDREN)
+    {
+        drop(m_prefetched.front());
+        m_prefetched.pop_front();
+    }
+
+    m_scheduler->start(TaskScheduler::Prefetch, task);
+}
+
+void DirectoryOpener::cancelPrefetch()
+{
+    m_prefetched.removeIf([](const Prefetch &prefetch)
+    {
+        if (prefetch.future.isFinished())
+            return false;
+
+        drop(prefetch);
+        return true;
+    });
 }
 
 void DirectoryOpener::openParentPath()
@@ -83,15 +312,87 @@ void DirectoryOpener::openParentPath()
     openPath(QString::fromStdString(p.generic_string()));
 }
 
-void DirectoryOpener::nextDir(QFuture<std::shared_ptr<Directory> > &&future)
+DirectoryOpener::Snapshot DirectoryOpener::snapshot(std::unique_ptr<Directory> dir, const QByteArray &version)
 {
+    if (!dir)
+        return {};
+
+    const auto url = dir->url();
+    return {url, std::move(dir), version};
+}
+
+void DirectoryOpener::nextDir(QFuture<Snapshot> &&future, const CancellationToken &cancel)
+{
+    // previous request is superseded, free its thread
+    m_cancel.cancel();
+    m_cancel = cancel;
+
     auto requestID = ++m_currentRequest;
-    future.then(this, [this, requestID](std::shared_ptr<Directory> dir)
+    future.then(this, [this, requestID](Snapshot snapshot)
     {
         if (requestID != m_currentRequest)
             return;
 
-        m_dir = dir;
-        emit directoryChanged();
+        setDir(std::move(snapshot));
+    });
+}
+
+DirectoryOpener::Prefetch DirectoryOpener::takePrefetched(const QUrl &url)
+{
+    const auto it = std::find_if(m_prefetched.begin(), m_prefetched.end(), [&url](const Prefetch &prefetch)
+    {
+        return prefetch.url == url;
     });
+
+    if (it == m_prefetched.end())
+        return {};
+
+    const Prefetch prefetch = *it;
+    m_prefetched.erase(it);
+
+    // queued task is skipped, regular open doesn't have to wait behind other work
+    if (!prefetch.claimed->exchange(true))
+        return {};
+
+    if (prefetch.age.elapsed() >= PREFETCH_MAX_AGE && prefetch.future.isFinished())
+        return {};
+
+    return prefetch;
+}
+
+void DirectoryOpener::drop(const Prefetch &prefetch)
+{
+    prefetch.claimed->store(true);
+    prefetch.cancel.cancel();
+}
+
+void DirectoryOpener::clearPrefetched()
+{
+    for (const auto &prefetch : std::as_const(m_prefetched))
+        drop(prefetch);
+
+    m_prefetched.clear();
+}
+
+void DirectoryOpener::setDir(Snapshot &&snapshot)
+{
+    if (m_dir != snapshot.dir)
+        clearPrefetched();
+
+    m_dir = snapshot.dir;
+
+    if (m_dir)
+    {
+        // unfinished snapshots which we are leaving are dropped, so that their reading is cancelled
+        m_recent.removeIf([&snapshot](const Snapshot &recent)
+        {
+            return recent.url == snapshot.url || !isComplete(recent.dir.get());
+        });
+
+        m_recent.prepend(std::move(snapshot));
+        if (m_recent.size() > RECENT_SNAPSHOTS)
+            m_recent.removeLast();
+    }
+
+    emit directoryChanged();
 }
@@ -3,40 +3,96 @@
 
 #include <QObject>
 #include <Qfuture>
+#include <QElapsedTimer>
+#include <QList>
+#include <QUrl>
+
+#include <atomic>
+
+#include "../core/cancellationtoken.hpp"
 
 class Directory;
 class DirectorySystem;;
-class QThreadPool;
+class TaskScheduler;
 
 class DirectoryOpener : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit DirectoryOpener(std::shared_ptr<QThreadPool> pool
+    explicit DirectoryOpener(std::shared_ptr<TaskScheduler> scheduler
                              , std::shared_ptr<DirectorySystem> system
                              , QObject *parent = nullptr);
+    ~DirectoryOpener();
 
     std::shared_ptr<Directory> dir() const;
 
 public slots:
     void openUrl(const QUrl &url);
+
+    // used for back/forward, a recently opened snapshot of @url is shown right away
+    // and revalidated in background, directoryChanged is emitted again only if it changed
+    void openRecentUrl(const QUrl &url);
+
     void openPath(const QString &path);
     void leanOpenPath(const QString &path);
     void openChild(const int child);
     void openParentPath();
 
+    // speculatively opens @child of current directory at low priority, a following
+    // openChild() of it picks up the result or joins the open if it is still running
+    void prefetchChild(const int child);
+
+    // drops and cancels speculative opens which haven't finished yet
+    void cancelPrefetch();
+
 signals:
     void directoryChanged();
 
 private:
-    void nextDir(QFuture<std::shared_ptr<Directory>> &&future);
+    struct Snapshot
+    {
+        QUrl url;
+        std::shared_ptr<Directory> dir;
+        QByteArray version; // see DirectorySystem::version
+    };
+
+    struct Prefetch
+    {
+        QUrl url;
+        QFuture<Snapshot> future;
 
-    std::shared_ptr<QThreadPool> m_pool;
+        // set by whoever gets to the open first, the queued task or cancellation
+        std::shared_ptr<std::atomic<bool>> claimed;
+        CancellationToken cancel;
+        QElapsedTimer age;
+    };
+
+    // @version is to be taken before @dir was opened, so that changes while it was read
+    // make the snapshot stale
+    static Snapshot snapshot(std::unique_ptr<Directory> dir, const QByteArray &version);
+
+    // @cancel belongs to the request of @future, it is cancelled once next request starts
+    void nextDir(QFuture<Snapshot> &&future, const CancellationToken &cancel);
+    void setDir(Snapshot &&snapshot);
+
+    // invalid future if @url wasn't prefetched or its open never started
+    Prefetch takePrefetched(const QUrl &url);
+    static void drop(const Prefetch &prefetch);
+    void clearPrefetched();
+
+    std::shared_ptr<TaskScheduler> m_scheduler;
     std::shared_ptr<DirectorySystem> m_system;
 
     uintmax_t m_currentRequest = 0;
+    CancellationToken m_cancel;
     std::shared_ptr<Directory> m_dir;
+
+    // most recent first
+    QList<Snapshot> m_recent;
+
+    // children of m_dir, oldest first
+    QList<Prefetch> m_prefetched;
 };
 
 #endif // DIRECTORYOPENER_HPP
@@ -7,6 +7,7 @@
 #include <qsqlerror.h>
 
 #include <QDataStream>
+#include <QPromise>
 
 
 namespace
@@ -70,3 +71,90 @@ QDataStream &operator>>(QDataStream &s, HistoryData &data)
 
     return s;
 }
+
+
+PathHistoryDB::PathHistoryDB(const QString &dbPath)
+{
+    m_worker.moveToThread(&m_thread);
+    m_thread.start();
+
+    QPromise<QHash<QString, HistoryData>> loading;
+    m_loading = loading.future();
+
+    // connection must be opened on the thread which uses it
+    QMetaObject::invokeMethod(&m_worker, [this, dbPath, loading = std::move(loading)]() mutable
+    {
+        m_store = std::make_unique<Store>(dbPath);
+
+        loading.start();
+        loading.addResult(m_store->values());
+        loading.finish();
+    });
+
+    m_writeTimer.setSingleShot(true);
+    m_writeTimer.setInterval(WRITE_DELAY);
+    m_writeTimer.callOnTimeout([this]() { flush(); });
+}
+
+PathHistoryDB::~PathHistoryDB()
+{
+    flush();
+
+    QMetaObject::invokeMethod(&m_worker, [this]() { m_store.reset(); }, Qt::BlockingQueuedConnection);
+
+    m_thread.quit();
+    m_thread.wait();
+}
+
+HistoryData PathHistoryDB::value(const QString &key)
+{
+    ensureLoaded();
+    return m_cache.value(key);
+}
+
+// every insert restarts the timer, i.e. moving through a list writes only once it stops
+void PathHistoryDB::insert(const QString &key, const HistoryData &value)
+{
+    m_cache.insert(key, value);
+    m_dirty.insert(key);
+    m_writeTimer.start();
+}
+
+void PathHistoryDB::flush()
+{
+    m_writeTimer.stop();
+    if (m_dirty.isEmpty())
+        return;
+
+    QHash<QString, HistoryData> values;
+    values.reserve(m_dirty.size());
+    for (const auto &key : std::as_const(m_dirty))
+        values.insert(key, m_cache.value(key));
+
+    m_dirty.clear();
+
+    QMetaObject::invokeMethod(&m_worker, [this, values = std::move(values)]()
+    {
+        if (m_store && !m_store->insert(values))
+            qWarning("failed to store path history, %s", qUtf8Printable(m_store->lastError()));
+    });
+}
+
+// history is read long before first lookup is made, this rarely waits
+void PathHistoryDB::ensureLoaded()
+{
+    if (m_loaded)
+        return;
+
+    m_loaded = true;
+
+    const auto loaded = m_loading.result();
+    for (auto it = loaded.cbegin(); it != loaded.cend(); ++it)
+    {
+        // inserted meanwhile, newer than stored one
+        if (!m_cache.contains(it.key()))
+            m_cache.insert(it.key(), it.value());
+    }
+
+    m_loading = {};
+}
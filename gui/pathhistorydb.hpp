@@ -2,7 +2,13 @@
 #define PATHHISTORYDB_HPP
 
 #include <QObject>
+#include <QFuture>
 #include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+#include <memory>
 
 #include "../core/persistenthash.hpp"
 
@@ -28,10 +34,46 @@ QDataStream &operator <<(QDataStream &s, const HistoryData &data);
 
 QDataStream &operator>>(QDataStream &s, HistoryData &data);
 
-class PathHistoryDB : public PersistentHash<HistoryData>
+/*
+ * write-back cache in front of PersistentHash, history is small, so all of it is read
+ * once on a worker thread, inserts only update memory and are written on that thread
+ * in one transaction once they have settled for WRITE_DELAY
+ *
+ * not thread-safe, use from thread which created it
+ */
+class PathHistoryDB
 {
 public:
-    PathHistoryDB(const QString &dbPath) : PersistentHash (dbPath) {}
+    static constexpr int WRITE_DELAY = 1000;
+
+    explicit PathHistoryDB(const QString &dbPath);
+    ~PathHistoryDB();
+
+    HistoryData value(const QString &key);
+    void insert(const QString &key, const HistoryData &value);
+
+    // hands pending inserts to the worker thread right away
+    void flush();
+
+private:
+    using Store = PersistentHash<HistoryData>;
+
+    void ensureLoaded();
+
+    QThread m_thread;
+
+    // lives in m_thread, context of all db access
+    QObject m_worker;
+
+    // only touched from m_thread
+    std::unique_ptr<Store> m_store;
+
+    QFuture<QHash<QString, HistoryData>> m_loading;
+    bool m_loaded = false;
+
+    QHash<QString, HistoryData> m_cache;
+    QSet<QString> m_dirty;
+    QTimer m_writeTimer;
 };
 
 #endif // PATHHISTORYDB_HPP
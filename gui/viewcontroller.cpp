@@ -5,9 +5,9 @@
 #include "../core/directorysortmodel.hpp"
 #include "../core/hybriddirsystem.hpp"
 #include "../core/filehistorydb.hpp"
+#include "../core/taskscheduler.hpp"
 #include "directoryopener.hpp"
 
-#include <QThreadPool>
 
 #include <QtConcurrent/QtConcurrent>
 #include <QMimeData>
@@ -15,15 +15,24 @@
 
 static const QString ICON_PROVIDER_ID = "fileicon";
 
+// selection has to rest this long before current row is opened speculatively
+static const int PREFETCH_DWELL = 300; // msecs
+
 
 ViewController::ViewController(QObject *parent)
     : QObject {parent}
-    , m_pool {std::make_unique<QThreadPool>()}
+    , m_scheduler {std::make_shared<TaskScheduler>()}
     , m_dirModel {std::make_unique<DirectorySystemModel>()}
     , m_sortModel { std::make_unique<DirectorySortModel>() }
     , m_system {std::make_unique<HybridDirSystem>()}
-    , m_dirOpener {std::make_unique<DirectoryOpener>(m_pool, m_system)}
+    , m_dirOpener {std::make_unique<DirectoryOpener>(m_scheduler, m_system)}
 {
+    // large directories and archives are shown while they are still being read
+    m_system->setIncrementalOpen(true);
+
+    // shown directory follows changes on disk
+    m_system->setWatchChanges(true);
+
     m_selectionModel.setModel(model());
 
     m_dirModel->setIconProvider([this](Directory *dir, int child) -> QString
@@ -56,10 +65,20 @@ ViewController::ViewController(QObject *parent)
 
     connect(&m_selectionModel, &QItemSelectionModel::currentChanged
             , this, &ViewController::updatePathHistory);
+
+    m_prefetchTimer.setSingleShot(true);
+    m_prefetchTimer.setInterval(PREFETCH_DWELL);
+
+    connect(&m_selectionModel, &QItemSelectionModel::currentChanged
+            , this, &ViewController::schedulePrefetch);
+
+    connect(&m_prefetchTimer, &QTimer::timeout
+            , this, &ViewController::prefetchCurrent);
 }
 
 ViewController::~ViewController()
 {
+    m_previewCancel.cancel();
 }
 
 QAbstractItemModel *ViewController::model()
@@ -130,7 +149,8 @@ void ViewController::setPreview(int row)
     const auto getPreviewData = [](
             std::shared_ptr<DirectorySystem> system,
             std::shared_ptr<Directory> dir,
-            int child) -> PreviewData
+            int child,
+            CancellationToken cancel) -> PreviewData
     {
         if (dir->isDir(child))
             return {nullptr, nullptr, PreviewData::Unknown, 0};
@@ -166,10 +186,13 @@ void ViewController::setPreview(int row)
         std::unique_ptr<IOSource> source;
 
         if (filetype == PreviewData::VideoFile)
-            device = system->iodevice(dir.get(), child);
+            device = system->iodevice(dir.get(), child, cancel);
+
+        if (!device && !cancel.isCancelled())
+            source = system->iosource(dir.get(), child, cancel);
 
-        if (!device)
-            source = system->iosource(dir.get(), child);
+        if (cancel.isCancelled())
+            return {}; // result is going to be ignored anyway
 
         if (!source && !device) {
             qDebug("failed to get iosource '%s'", qUtf8Printable(dir->fileUrl(child).toString()));
@@ -187,8 +210,10 @@ void ViewController::setPreview(int row)
         return;
     }
 
-    // skip previous request
+    // skip previous request, and stop its extraction
     const size_t requestID = ++m_previewRequest;
+    m_previewCancel.cancel();
+    m_previewCancel = CancellationToken::create();
 
     auto root = m_dirModel->directory();
     if (!root)
@@ -196,8 +221,8 @@ void ViewController::setPreview(int row)
 
     using FutureVariant = std::variant<QFuture<PreviewData>, QFuture<FileHistoryDB::Data>>;
 
-    QFuture<PreviewData> preview = QtConcurrent::run(
-                m_pool.get(), getPreviewData, m_system, root, directoryRow);
+    QFuture<PreviewData> preview = m_scheduler->run(
+                TaskScheduler::Preview, getPreviewData, m_system, root, directoryRow, m_previewCancel);
 
     QFuture<FileHistoryDB::Data> data = m_historyDB->read(root->filePath(directoryRow));
 
@@ -257,7 +282,9 @@ void ViewController::updateModel()
     m_url = dir->url();
 
     auto history = m_pathHistoryDB->value(m_url.toString());
-    m_dirModel->setDirectory(dir);
+
+    // selection model already followed rows which moved, saved row may now be another entry
+    const bool inPlace = m_dirModel->setDirectory(dir);
 
     if (history.onlyShowVideoFiles.has_value())
         m_sortModel->setOnlyShowVideoFile(history.onlyShowVideoFiles.value());
@@ -269,7 +296,8 @@ void ViewController::updateModel()
         auto current = m_sortModel->index(history.random_row.value_or(0)
                                           , history.random_col.value_or(0));
 
-        m_selectionModel.setCurrentIndex(current, QItemSelectionModel::ClearAndSelect);
+        if (!inPlace)
+            m_selectionModel.setCurrentIndex(current, QItemSelectionModel::ClearAndSelect);
     }
     else
     {
@@ -288,7 +316,8 @@ void ViewController::updateModel()
         auto current = m_sortModel->index(history.row.value_or(0)
                                           , history.col.value_or(0));
 
-        m_selectionModel.setCurrentIndex(current, QItemSelectionModel::ClearAndSelect);
+        if (!inPlace)
+            m_selectionModel.setCurrentIndex(current, QItemSelectionModel::ClearAndSelect);
     }
 
     if (m_historyDB)
@@ -327,7 +356,6 @@ void ViewController::updatePathHistory()
 
     history.onlyShowVideoFiles = m_sortModel->onlyShowVideoFile();
 
-    qDebug() << "new history" << url << history.row << history.col;
     m_pathHistoryDB->insert(url, history);
 }
 
@@ -336,7 +364,33 @@ void ViewController::syncUrl()
     if (loading() || (m_history.size() > 0 && m_url == m_history.currentUrl()))
         return;
 
-    openUrl(m_history.currentUrl());
+    // back/forward, show what we had and let the opener revalidate it, sort and
+    // selection state is restored from path history in updateModel()
+    m_dirOpener->openRecentUrl(m_history.currentUrl());
+}
+
+void ViewController::schedulePrefetch()
+{
+    m_dirOpener->cancelPrefetch();
+    m_prefetchTimer.start();
+}
+
+void ViewController::prefetchCurrent()
+{
+    // opener and model may disagree while a directory is being opened
+    auto dir = m_dirModel->directory();
+    if (loading() || !dir || dir != m_dirOpener->dir())
+        return;
+
+    const int child = sourceRow(m_selectionModel.currentIndex().row());
+    if (child == -1)
+        return;
+
+    const bool container = dir->isDir(child)
+                           || (m_fileBrowser && m_fileBrowser->isContainer(dir->filePath(child)));
+
+    if (container)
+        m_dirOpener->prefetchChild(child);
 }
 
 void ViewController::updateHistoryStack()
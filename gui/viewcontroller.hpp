@@ -8,6 +8,7 @@
 #include <QFutureWatcher>
 #include <QAbstractItemModel>
 #include <QItemSelectionModel>
+#include <QTimer>
 
 #include "../core/hybriddirsystem.hpp"
 #include "iconprovider.hpp"
@@ -22,7 +23,7 @@ class DirectorySortModel;
 class FileHistoryDB;
 class PathHistoryDB;
 class DirectoryOpener;
-class QThreadPool;
+class TaskScheduler;
 
 class PreviewData
 {
@@ -142,6 +143,10 @@ private slots:
 
     void updateHistoryStack();
 
+    void schedulePrefetch();
+
+    void prefetchCurrent();
+
 private:
     int sourceRow(const int row);
 
@@ -151,7 +156,7 @@ private:
 
     // place this at start so it get destroyed last, this
     // make sure any pending operation don't use invalid resource
-    std::shared_ptr<QThreadPool> m_pool;
+    std::shared_ptr<TaskScheduler> m_scheduler;
 
     // owned by qqmlengine
     IconProvider *m_iconProvider {};
@@ -167,6 +172,7 @@ private:
     std::unique_ptr<DirectoryOpener> m_dirOpener;
 
     size_t m_previewRequest = 0;
+    CancellationToken m_previewCancel;
 
     FileBrowser *m_fileBrowser = nullptr;
     bool m_loading;
@@ -176,6 +182,9 @@ private:
     std::shared_ptr<PathHistoryDB> m_pathHistoryDB;
 
     QItemSelectionModel m_selectionModel;
+
+    // current row is opened speculatively once selection stays on it
+    QTimer m_prefetchTimer;
 };
 
 #endif // VIEWCONTROLLER_HPP
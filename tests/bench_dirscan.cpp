@@ -0,0 +1,105 @@
+#include <QObject>
+#include <QTest>
+
+#include "../core/filesystem.hpp"
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+/*
+ * compares FileSystem listing against plain QDir::entryInfoList() on a synthetic tree,
+ * size of tree can be changed with BENCH_DIRSCAN_FILES and BENCH_DIRSCAN_DIRS
+ */
+class BenchDirScan : public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+private:
+    // what FileSystem used to do per entry
+    static qint64 qdirList(const QString &path, bool flatMode)
+    {
+        qint64 count = 0;
+        const QFileInfoList list = QDir(path).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
+        for (const auto &fileInfo : list)
+        {
+            if (flatMode && fileInfo.isDir())
+            {
+                count += qdirList(fileInfo.absoluteFilePath(), flatMode);
+                continue;
+            }
+
+            QString name = fileInfo.fileName();
+            QString path = fileInfo.absoluteFilePath();
+            Q_UNUSED(fileInfo.size());
+            Q_UNUSED(fileInfo.lastRead());
+            Q_UNUSED(fileInfo.birthTime());
+            Q_UNUSED(fileInfo.lastModified());
+            ++count;
+        }
+
+        return count;
+    }
+
+    QTemporaryDir m_dir;
+    qint64 m_totalFiles = 0;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+
+        const int files = qEnvironmentVariableIntValue("BENCH_DIRSCAN_FILES") > 0
+                ? qEnvironmentVariableIntValue("BENCH_DIRSCAN_FILES") : 20000;
+        const int dirs = qEnvironmentVariableIntValue("BENCH_DIRSCAN_DIRS") > 0
+                ? qEnvironmentVariableIntValue("BENCH_DIRSCAN_DIRS") : 100;
+
+        QDir root(m_dir.path());
+        for (int d = 0; d < dirs; ++d)
+            QVERIFY(root.mkdir(QString("dir%1").arg(d)));
+
+        // half in root, rest spread over sub directories
+        for (int i = 0; i < files; ++i)
+        {
+            const QString name = (i % 2 == 0)
+                    ? QString("file%1.dat").arg(i)
+                    : QString("dir%1/file%2.dat").arg(i % dirs).arg(i);
+
+            QFile f(root.absoluteFilePath(name));
+            QVERIFY(f.open(QIODevice::WriteOnly));
+            f.write(QByteArray(i % 64, 'x'));
+        }
+
+        m_totalFiles = files;
+    }
+
+    void qdirOpen()
+    {
+        QBENCHMARK { qdirList(m_dir.path(), false); }
+    }
+
+    void fileSystemOpen()
+    {
+        FileSystem s;
+        QBENCHMARK { s.open(m_dir.path()); }
+    }
+
+    void qdirLeanOpen()
+    {
+        qint64 count = 0;
+        QBENCHMARK { count = qdirList(m_dir.path(), true); }
+        QCOMPARE(count, m_totalFiles);
+    }
+
+    void fileSystemLeanOpen()
+    {
+        FileSystem s;
+        int count = 0;
+        QBENCHMARK { count = s.leanOpen(m_dir.path())->fileCount(); }
+        QCOMPARE(count, m_totalFiles);
+    }
+};
+
+QTEST_MAIN(BenchDirScan)
+#include "bench_dirscan.moc"
@@ -26,9 +26,12 @@ private slots:
     void test08_ReopenAfterClose();
     void test09_ConcurrentIODevices();
     void test10_QDataStreamIntegration();
+    void test11_ScatteredAccess();
 
 private:
-    QString createTestArchive(const QString &archiveName, const QMap<QString, QByteArray> &files);
+    QString createTestArchive(const QString &archiveName,
+                              const QMap<QString, QByteArray> &files,
+                              bool gzip = false);
     QByteArray generateTestData(qint64 size);
     QByteArray generatePatternData(qint64 size);
 
@@ -43,12 +46,15 @@ void TestAsyncArchiveIODevice::initTestCase()
 void TestAsyncArchiveIODevice::cleanupTestCase() {}
 
 QString TestAsyncArchiveIODevice::createTestArchive(const QString &archiveName,
-                                                    const QMap<QString, QByteArray> &files)
+                                                    const QMap<QString, QByteArray> &files,
+                                                    bool gzip)
 {
     QString archivePath = m_tempDir.filePath(archiveName);
 
     struct archive *a = archive_write_new();
     archive_write_set_format_pax_restricted(a);
+    if (gzip)
+        archive_write_add_filter_gzip(a);
     archive_write_open_filename(a, archivePath.toUtf8().constData());
 
     for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
@@ -539,5 +545,60 @@ void TestAsyncArchiveIODevice::test10_QDataStreamIntegration()
     device.close();
 }
 
+// Test 11: Alternating between distant regions, like a demuxer reading index and data
+void TestAsyncArchiveIODevice::test11_ScatteredAccess()
+{
+    const QByteArray testData = generatePatternData(24 * 1024 * 1024);
+    QMap<QString, QByteArray> files;
+    files["scattered.dat"] = testData;
+
+    // three regions far apart from each other, each read continues where the last one
+    // in that region stopped
+    const auto readRegions = [&](AsyncArchiveIODevice &device, int maxReaders) {
+        QVector<qint64> regions = {0, 10 * 1024 * 1024, 20 * 1024 * 1024};
+        const qint64 readSize = 64 * 1024;
+
+        for (int round = 0; round < 8; ++round) {
+            for (auto &regionPos : regions) {
+                QVERIFY(device.seek(regionPos));
+
+                QByteArray chunk = device.read(readSize);
+                QCOMPARE(chunk.size(), readSize);
+                QCOMPARE(chunk, testData.mid(regionPos, readSize));
+                QVERIFY(device.readerCount() <= maxReaders);
+
+                regionPos += readSize;
+            }
+        }
+    };
+
+    // seekable entry, every region keeps a reader of its own
+    {
+        QString archive = createTestArchive("test11.tar", files);
+
+        AsyncArchiveIODevice device(archive, "scattered.dat", testData.size(), true);
+        QVERIFY(device.open(QIODevice::ReadOnly));
+
+        readRegions(device, 3);
+        QCOMPARE(device.readersStarted(), 3);
+
+        device.close();
+    }
+
+    // compressed stream, extra readers would each decompress from the start, so a
+    // single one is repositioned
+    {
+        QString archive = createTestArchive("test11.tar.gz", files, true);
+
+        AsyncArchiveIODevice device(archive, "scattered.dat", testData.size());
+        QVERIFY(device.open(QIODevice::ReadOnly));
+
+        readRegions(device, 1);
+        QCOMPARE(device.readerCount(), 1);
+
+        device.close();
+    }
+}
+
 QTEST_MAIN(TestAsyncArchiveIODevice)
 #include "test_AsyncArchiveIODevice.moc"
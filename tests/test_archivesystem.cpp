@@ -3,8 +3,15 @@
 
 #include "../core/archivesystem.hpp"
 #include "../core/hybriddirsystem.hpp"
+#include "../core/targetclassifier.hpp"
+#include "../core/asyncarchiveiodevice.h"
+#include "../core/CachedFileDevice.h"
+#include "../core/FileRangeDevice.h"
 #include "qtestcase.h"
 #include <QDir>
+#include <QTemporaryDir>
+#include <QSemaphore>
+#include <QThreadPool>
 
 #include <QFile>
 #include <array>
@@ -204,6 +211,154 @@ private slots:
         test(s);
         testRecursiveArchive(s);
     }
+
+    void testClassifier()
+    {
+        using Target = TargetClassifier::Target;
+
+        const auto d = QDir(QFileInfo(__FILE__).dir().absoluteFilePath("archivedir"));
+        const auto archivepath = d.absoluteFilePath("archivetest.zip");
+
+        TargetClassifier c;
+        QCOMPARE(c.classify(d.absolutePath()).target, Target::Directory);
+        QCOMPARE(c.classify(d.absoluteFilePath("test.txt")).target, Target::Unsupported);
+        QCOMPARE(c.classify(d.absoluteFilePath("notexistentfile")).target, Target::Missing);
+
+        const auto archive = c.classify(archivepath);
+        QCOMPARE(archive.target, Target::Archive);
+        QCOMPARE(archive.archivePath, archivepath);
+
+        const auto inside = c.classify(archivepath + "/lol/tar");
+        QCOMPARE(inside.target, Target::InsideArchive);
+        QCOMPARE(inside.archivePath, archivepath);
+        QCOMPARE(inside.innerPath, "/lol/tar");
+
+        // without a known suffix, content decides
+        QTemporaryDir tmp;
+        QVERIFY(tmp.isValid());
+
+        const auto renamed = tmp.filePath("archive");
+        QVERIFY(QFile::copy(archivepath, renamed));
+        QCOMPARE(c.classify(renamed).target, Target::Archive);
+
+        HybridDirSystem s;
+        QVERIFY(s.open(QUrl::fromLocalFile(renamed)));
+        QVERIFY(s.open(archivepath + "/lol"));
+        QVERIFY(!s.open(d.absoluteFilePath("test.txt")));
+    }
+
+    void testCancelledOpen()
+    {
+        auto d = QDir(QFileInfo(__FILE__).dir().absoluteFilePath("archivedir"));
+        const auto archiveurl = QUrl::fromLocalFile(d.absoluteFilePath("archivedir.zip"));
+
+        ArchiveSystem s;
+        auto f = s.open(archiveurl);
+        QVERIFY(f);
+
+        const auto cancel = CancellationToken::create();
+        cancel.cancel();
+
+        QVERIFY(!s.open(archiveurl, cancel));
+        QVERIFY(!s.open(f.get(), 0, cancel)); // nested archive isn't extracted
+        QVERIFY(!s.iosource(f.get(), 0, cancel));
+
+        HybridDirSystem s2;
+        QVERIFY(!s2.open(archiveurl, cancel));
+    }
+
+    void testIncrementalOpen()
+    {
+        auto d = QDir(QFileInfo(__FILE__).dir().absoluteFilePath("archivedir"));
+        const auto archiveurl = QUrl::fromLocalFile(d.absoluteFilePath("archivetest.zip"));
+
+        ArchiveSystem s;
+        s.setIncrementalOpen(true);
+
+        // archive readers park on global pool, that mustn't hold up opens
+        auto global = QThreadPool::globalInstance();
+        QSemaphore release;
+        for (int i = 0; i < global->maxThreadCount(); ++i)
+            global->start([&release]() { release.acquire(); });
+
+        auto f = s.open(archiveurl);
+        QVERIFY(f);
+
+        auto incremental = dynamic_cast<IncrementalDirectory *>(f.get());
+        QVERIFY(incremental);
+        QTRY_VERIFY(incremental->isComplete());
+        QCOMPARE(f->fileCount(), 2);
+
+        release.release(global->maxThreadCount());
+        global->waitForDone();
+
+        const auto cancel = CancellationToken::create();
+        cancel.cancel();
+        QVERIFY(!s.open(archiveurl, cancel));
+    }
+
+    void testReadStrategy()
+    {
+        const auto d = QDir(QFileInfo(__FILE__).dir().absoluteFilePath("archivedir"));
+
+        ArchiveSystem s;
+        auto root = s.open(QUrl::fromLocalFile(d.absoluteFilePath("archivetest.zip")));
+        QVERIFY(root);
+
+        const auto readDevice = [&s](Directory *dir, const QString &name) -> std::unique_ptr<QIODevice>
+        {
+            for (int i = 0; i < dir->fileCount(); ++i)
+            {
+                if (dir->fileName(i) != name)
+                    continue;
+
+                auto device = s.iodevice(dir, i);
+                return device ? device->readDevice() : nullptr;
+            }
+
+            return nullptr;
+        };
+
+        // stored zip entry is read straight from the archive file
+        auto lol = s.open(root.get(), 0);
+        QVERIFY(lol);
+        auto tar = s.open(lol.get(), 0);
+        QVERIFY(tar);
+
+        auto stored = readDevice(tar.get(), "new.txt");
+        QVERIFY(dynamic_cast<FileRangeDevice *>(stored.get()));
+        QVERIFY(stored->open(QIODevice::ReadOnly));
+        QCOMPARE(stored->readAll(), "lolpoisonutrypop");
+        QVERIFY(stored->seek(3));
+        QCOMPARE(stored->read(6), "poison");
+
+        // zip has no archive_seek_data(), deflated entries are decoded once and cached
+        auto deflated = readDevice(root.get(), "test.txt");
+        QVERIFY(dynamic_cast<CachedFileDevice *>(deflated.get()));
+        deflated->close();
+
+        // rar v4 entries can be seeked into, rar isn't writable by libarchive so
+        // a minimal archive with one stored entry is written by hand
+        QTemporaryDir tmp;
+        QVERIFY(tmp.isValid());
+
+        const auto rarPath = tmp.filePath("stored.rar");
+        QFile rar(rarPath);
+        QVERIFY(rar.open(QIODevice::WriteOnly));
+        rar.write(QByteArray::fromHex("526172211a0700cf907300000d00000000000000811c7400802a0010"
+                                      "0000001000000003a1ea7f0f0000215a14300a00a481000073746f72"
+                                      "65642e7478746c6f6c706f69736f6e75747279706f70c43d7b004007"
+                                      "00"));
+        rar.close();
+
+        auto rarRoot = s.open(QUrl::fromLocalFile(rarPath));
+        QVERIFY(rarRoot);
+
+        auto seekable = readDevice(rarRoot.get(), "stored.txt");
+        QVERIFY(dynamic_cast<AsyncArchiveIODevice *>(seekable.get()));
+        QVERIFY(seekable->open(QIODevice::ReadOnly));
+        QCOMPARE(seekable->readAll(), "lolpoisonutrypop");
+    }
 };
 
 
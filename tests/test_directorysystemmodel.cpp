@@ -1,10 +1,39 @@
 #include <QObject>
 #include <QTest>
+#include <QSignalSpy>
+#include <QAbstractItemModelTester>
+#include <QTemporaryDir>
 
+#include "../core/directorysortmodel.hpp"
 #include "../core/directorysystemmodel.hpp"
+#include "../core/filehistorydb.hpp"
 #include "../core/hybriddirsystem.hpp"
 #include "qtestcase.h"
 
+// in memory snapshot of a directory, all snapshots share the url
+class SnapshotDirectory : public Directory
+{
+public:
+    QList<std::pair<QString, qint64>> files;
+
+    SnapshotDirectory(QList<std::pair<QString, qint64>> files) : files {files} {}
+
+    QString path() override { return "/snapshot"; }
+    QString name() override { return "snapshot"; }
+    QUrl url() override { return QUrl::fromLocalFile(path()); }
+
+    int fileCount() override { return files.size(); }
+    QString fileName(int i) override { return files[i].first; }
+    QString filePath(int i) override { return path() + '/' + files[i].first; }
+    QUrl fileUrl(int i) override { return QUrl::fromLocalFile(filePath(i)); }
+    qint64 fileSize(int i) override { return files[i].second; }
+    bool isDir(int i) override { return false; }
+
+    QDateTime fileLastAccessTime(int i) override { return {}; }
+    QDateTime fileCreationTime(int i) override { return {}; }
+    QDateTime fileModifiedTime(int i) override { return {}; }
+};
+
 
 class TestDirectorySystemModel : public QObject
 {
@@ -31,6 +60,219 @@ private slots:
         // name : {path, size}
     }
 
+    void testUpdateInPlace()
+    {
+        DirectorySystemModel m;
+        QAbstractItemModelTester tester(&m, QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+        const auto names = [&m]()
+        {
+            QStringList r;
+            for (int i = 0; i < m.rowCount(); ++i)
+                r.push_back(m.index(i, 0).data(DirectorySystemModel::NameRole).toString());
+            return r;
+        };
+
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}}));
+
+        QSignalSpy resets(&m, &QAbstractItemModel::modelReset);
+        QSignalSpy removed(&m, &QAbstractItemModel::rowsRemoved);
+        QSignalSpy inserted(&m, &QAbstractItemModel::rowsInserted);
+        QSignalSpy changed(&m, &QAbstractItemModel::dataChanged);
+        QSignalSpy moved(&m, &QAbstractItemModel::rowsMoved);
+
+        const QPersistentModelIndex d = m.index(3, 0);
+
+        // same content, nothing to report
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}}));
+
+        QCOMPARE(removed.size() + inserted.size() + changed.size() + moved.size(), 0);
+
+        // 'b' is gone, 'c' changed and 'e' is new
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"c", 30}, {"d", 4}, {"e", 5}}));
+
+        QCOMPARE(names(), QStringList({"a", "c", "d", "e"}));
+        QCOMPARE(removed.size(), 1);
+        QCOMPARE(inserted.size(), 1);
+        QCOMPARE(changed.size(), 1);
+        QCOMPARE(m.index(1, 0).data(DirectorySystemModel::SizeRole).toLongLong(), 30);
+        QCOMPARE(d.row(), 2);
+
+        // reordered
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"d", 4}, {"a", 1}, {"c", 30}, {"e", 5}}));
+
+        QCOMPARE(names(), QStringList({"d", "a", "c", "e"}));
+        QCOMPARE(moved.size(), 1);
+        QCOMPARE(d.row(), 0);
+
+        QCOMPARE(resets.size(), 0);
+    }
+
+    void testDisplayCache()
+    {
+        DirectorySystemModel m;
+
+        QList<std::pair<QString, qint64>> files;
+        for (int i = 0; i < 300; ++i)
+            files.push_back({QString::number(i), i * 1000});
+
+        m.setDirectory(std::make_shared<SnapshotDirectory>(files));
+
+        const auto size = [&m](int row)
+        {
+            return m.index(row, DirectorySystemModel::SizeColumn).data(Qt::DisplayRole).toString();
+        };
+
+        const auto l = QLocale::system();
+        QCOMPARE(size(299), l.formattedDataSize(299 * 1000));
+        QCOMPARE(size(0), l.formattedDataSize(0));
+        QCOMPARE(m.index(1, DirectorySystemModel::PathColumn).data(Qt::DisplayRole).toString()
+                 , QDir::toNativeSeparators("/snapshot/1"));
+
+        // same url, rows are updated in place, formatted strings must follow
+        files[299].second = 1;
+        m.setDirectory(std::make_shared<SnapshotDirectory>(files));
+        QCOMPARE(size(299), l.formattedDataSize(1));
+    }
+
+    void testCoalescedChanges()
+    {
+        QTemporaryDir tmp;
+        QVERIFY(tmp.isValid());
+
+        DirectorySystemModel m;
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}}));
+
+        QSignalSpy changed(&m, &QAbstractItemModel::dataChanged);
+
+        // history of whole directory is read at once and reported once
+        m.setFileHistoryDB(std::make_shared<FileHistoryDB>(tmp.filePath("history.db")));
+        QTRY_COMPARE(changed.size(), 1);
+        QCOMPARE(changed[0][0].value<QModelIndex>().row(), 0);
+        QCOMPARE(changed[0][1].value<QModelIndex>().row(), 4);
+
+        changed.clear();
+        m.setData(m.index(0, 0), true, DirectorySystemModel::SeenRole);
+        m.setData(m.index(1, 0), true, DirectorySystemModel::SeenRole);
+        m.setData(m.index(2, 0), .5, DirectorySystemModel::ProgressRole);
+        m.setData(m.index(4, 0), true, DirectorySystemModel::PreviewedRole);
+
+        // nothing till the event loop runs
+        QCOMPARE(changed.size(), 0);
+
+        QTRY_COMPARE(changed.size(), 2);
+        QCOMPARE(changed[0][0].value<QModelIndex>().row(), 0);
+        QCOMPARE(changed[0][1].value<QModelIndex>().row(), 2);
+
+        const auto roles = changed[0][2].value<QList<int>>();
+        QVERIFY(roles.contains(DirectorySystemModel::SeenRole));
+        QVERIFY(roles.contains(DirectorySystemModel::ProgressRole));
+        QVERIFY(!roles.contains(DirectorySystemModel::PreviewedRole));
+
+        QCOMPARE(changed[1][0].value<QModelIndex>().row(), 4);
+    }
+
+    void testApplyHistory()
+    {
+        QTemporaryDir tmp;
+        QVERIFY(tmp.isValid());
+
+        DirectorySystemModel m;
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"b", 2}, {"c", 3}}));
+
+        auto db = std::make_shared<FileHistoryDB>(tmp.filePath("history.db"));
+        m.setFileHistoryDB(db);
+
+        QSignalSpy changed(&m, &QAbstractItemModel::dataChanged);
+        QTRY_COMPARE(changed.size(), 1);
+
+        changed.clear();
+        m.applyHistory(FileHistoryDB::BulkOperation::MarkSeen);
+
+        // shown right away, with one notification
+        for (int row = 0; row < m.rowCount(); ++row)
+            QCOMPARE(m.index(row, 0).data(DirectorySystemModel::SeenRole).toBool(), true);
+
+        QTRY_COMPARE(changed.size(), 1);
+        QCOMPARE(changed[0][0].value<QModelIndex>().row(), 0);
+        QCOMPARE(changed[0][1].value<QModelIndex>().row(), 2);
+
+        QTRY_VERIFY(db->read("/snapshot/c").result().seen.value_or(false));
+
+        m.applyHistory(FileHistoryDB::BulkOperation::MarkUnseen, {1});
+        QCOMPARE(m.index(0, 0).data(DirectorySystemModel::SeenRole).toBool(), true);
+        QCOMPARE(m.index(1, 0).data(DirectorySystemModel::SeenRole).toBool(), false);
+        QTRY_VERIFY(!db->read("/snapshot/b").result().seen.value_or(true));
+    }
+
+    void testApplyHistoryRecursively()
+    {
+        QTemporaryDir tmp;
+        QVERIFY(tmp.isValid());
+
+        DirectorySystemModel m;
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"a", 1}, {"b", 2}}));
+
+        auto db = std::make_shared<FileHistoryDB>(tmp.filePath("history.db"));
+        m.setFileHistoryDB(db);
+
+        QSignalSpy changed(&m, &QAbstractItemModel::dataChanged);
+        QTRY_COMPARE(changed.size(), 1);
+
+        // not shown, but it's in the tree
+        db->setProgress("/snapshot/deep/x", .5);
+        db->setProgress("/elsewhere/y", .5);
+
+        m.applyHistoryRecursively(FileHistoryDB::BulkOperation::MarkSeen);
+        for (int row = 0; row < m.rowCount(); ++row)
+            QCOMPARE(m.index(row, 0).data(DirectorySystemModel::SeenRole).toBool(), true);
+
+        QTRY_VERIFY(db->read("/snapshot/deep/x").result().seen.value_or(false));
+        QTRY_VERIFY(db->read("/snapshot/a").result().seen.value_or(false));
+        QVERIFY(!db->read("/elsewhere/y").result().seen.has_value());
+
+        m.applyHistoryRecursively(FileHistoryDB::BulkOperation::ResetProgress);
+        QTRY_COMPARE(db->read("/snapshot/deep/x").result().progress.value_or(1), 0.);
+        QCOMPARE(db->read("/elsewhere/y").result().progress.value_or(0), .5);
+    }
+
+    void testSort()
+    {
+        DirectorySystemModel m;
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"b", 3}, {"C", 1}, {"a", 2}}));
+
+        DirectorySortModel sort;
+        sort.setSortRole(DirectorySystemModel::DataRole);
+        sort.setSourceModel(&m);
+
+        const auto names = [&sort]()
+        {
+            QStringList r;
+            for (int i = 0; i < sort.rowCount(); ++i)
+                r.push_back(sort.index(i, 0).data(DirectorySystemModel::NameRole).toString());
+            return r;
+        };
+
+        sort.sort(DirectorySystemModel::SizeColumn, Qt::AscendingOrder);
+        QCOMPARE(names(), QStringList({"C", "a", "b"}));
+
+        sort.sort(DirectorySystemModel::NameColumn, Qt::DescendingOrder);
+        QCOMPARE(names(), QStringList({"C", "b", "a"}));
+
+        // rows follow changes of source
+        m.setDirectory(std::make_shared<SnapshotDirectory>(QList<std::pair<QString, qint64>>
+            {{"b", 3}, {"d", 4}, {"a", 2}}));
+        QCOMPARE(names(), QStringList({"d", "b", "a"}));
+    }
+
 };
 
 
@@ -0,0 +1,299 @@
+#include <QObject>
+#include <QTest>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "../core/filehistorydb.hpp"
+
+class TestFileHistoryDB : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir m_dir;
+
+    QString dbPath(const QString &name) const { return m_dir.filePath(name); }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+    }
+
+    void testRead()
+    {
+        FileHistoryDB db(dbPath("read.db"));
+        db.setSeen("/a", true);
+        db.setProgress("/a", .5);
+
+        auto f = db.read("/a");
+        f.waitForFinished();
+
+        const auto data = f.result();
+        QCOMPARE(data.seen.value_or(false), true);
+        QCOMPARE(data.progress.value_or(0), .5);
+        QVERIFY(!data.previewed.value_or(false));
+
+        auto missing = db.read("/missing");
+        missing.waitForFinished();
+        QVERIFY(!missing.result().seen.has_value());
+    }
+
+    void testReadBatch()
+    {
+        FileHistoryDB db(dbPath("batch.db"));
+        db.setSeen("/dir/a", true);
+        db.setPreviewed("/dir/c", true);
+
+        auto f = db.readBatch({"/dir/a", "/dir/b", "/dir/c", "/dir/a"});
+        f.waitForFinished();
+
+        const auto found = f.result();
+        QCOMPARE(found.size(), 2);
+        QCOMPARE(found.value("/dir/a").seen.value_or(false), true);
+        QCOMPARE(found.value("/dir/c").previewed.value_or(false), true);
+        QVERIFY(!found.contains("/dir/b"));
+
+        // lookup table doesn't leak into the next batch
+        auto next = db.readBatch({"/dir/b"});
+        next.waitForFinished();
+        QVERIFY(next.result().isEmpty());
+    }
+
+    void testWriteBehind()
+    {
+        const auto path = dbPath("writebehind.db");
+
+        {
+            FileHistoryDB db(path);
+            for (int i = 0; i <= 100; ++i)
+                db.setProgress("/video", i / 100.);
+
+            db.setSeen("/video", true);
+
+            // not flushed yet, but reads see it
+            auto f = db.read("/video");
+            f.waitForFinished();
+            QCOMPARE(f.result().progress.value_or(0), 1.);
+
+            auto batch = db.readBatch({"/video"});
+            batch.waitForFinished();
+            QCOMPARE(batch.result().value("/video").seen.value_or(false), true);
+        }
+
+        // flushed on destruction
+        FileHistoryDB db(path);
+        auto f = db.read("/video");
+        f.waitForFinished();
+        QCOMPARE(f.result().progress.value_or(0), 1.);
+        QCOMPARE(f.result().seen.value_or(false), true);
+
+        // columns not written keep their values
+        db.setPreviewed("/video", true);
+        auto updated = db.read("/video");
+        updated.waitForFinished();
+        QCOMPARE(updated.result().progress.value_or(0), 1.);
+        QCOMPARE(updated.result().previewed.value_or(false), true);
+    }
+
+    void testReadMetrics()
+    {
+        FileHistoryDB db(dbPath("metrics.db"));
+        QCOMPARE(db.readMetrics().reads, 0);
+
+        // reads go to readers while writer is busy with writes
+        QList<QFuture<FileHistoryDB::Data>> reads;
+        for (int i = 0; i < 50; ++i)
+        {
+            const auto mrl = QString("/metrics/%1").arg(i);
+            db.setSeen(mrl, true);
+            reads.push_back(db.read(mrl));
+        }
+
+        for (auto &f : reads)
+        {
+            f.waitForFinished();
+            QCOMPARE(f.result().seen.value_or(false), true);
+        }
+
+        // latency is recorded after result is reported
+        QTRY_COMPARE(db.readMetrics().reads, 50);
+
+        const auto metrics = db.readMetrics();
+        QVERIFY(metrics.p50 <= metrics.p90);
+        QVERIFY(metrics.p90 <= metrics.p99);
+        QVERIFY(metrics.p99 <= metrics.max);
+    }
+
+    void testFolderSummary()
+    {
+        FileHistoryDB db(dbPath("summary.db"));
+
+        const auto summary = [&db](const QString &path)
+        {
+            auto f = db.readFolderSummary(path);
+            f.waitForFinished();
+            return f.result();
+        };
+
+        db.setFolderSummary("/lib/a", {4, 1, 2, 1.5});
+        db.setFolderSummary("/lib/a/b", {2, 2, 0, 2});
+        db.setFolderSummary("/lib/c", {3, 0, 0, 0});
+
+        QCOMPARE(summary("/lib/a/b").files, 2);
+        QCOMPARE(summary("/lib/a").files, 6);
+        QCOMPARE(summary("/lib/a").seen, 3);
+        QCOMPARE(summary("/lib").files, 9);
+        QCOMPARE(summary("/lib").progress, 3.5);
+
+        // replaced summary only moves totals by the difference
+        db.setFolderSummary("/lib/a/b", {2, 0, 1, 0});
+        QCOMPARE(summary("/lib/a").seen, 1);
+        QCOMPARE(summary("/lib").seen, 1);
+        QCOMPARE(summary("/lib").previewed, 3);
+        QCOMPARE(summary("/lib").files, 9);
+
+        QCOMPARE(summary("/unknown").files, 0);
+
+        // queued summaries of a path are coalesced, only the latest is written
+        for (int i = 0; i < 100; ++i)
+            db.setFolderSummary("/lib/c", {3, i % 4, 0, 0});
+
+        QCOMPARE(summary("/lib/c").seen, 3);
+        QCOMPARE(summary("/lib").seen, 4);
+        QCOMPARE(summary("/lib").files, 9);
+    }
+
+    void testBulk()
+    {
+        FileHistoryDB db(dbPath("bulk.db"));
+
+        const auto summary = [&db](const QString &path)
+        {
+            auto f = db.readFolderSummary(path);
+            f.waitForFinished();
+            return f.result();
+        };
+
+        // bulk operations are meant to stay well under a second for this many rows,
+        // times are reported, not asserted, they depend on the machine
+        constexpr int ROWS = 100000;
+
+        QStringList mrls;
+        for (int i = 0; i < ROWS; ++i)
+            mrls.push_back(QString("/bulk/%1/%2").arg(i % 2 ? "a" : "b").arg(i));
+
+        db.setProgress(mrls[0], .5);
+        db.setFolderSummary("/bulk/a", {ROWS / 2, 0, 0, 0});
+        db.setFolderSummary("/bulk/b", {ROWS / 2, 0, 0, .5});
+
+        // only 2 of 10 files in c have history
+        db.setFolderSummary("/bulk/c", {10, 0, 0, 0});
+        db.setProgress("/bulk/c/1", .5);
+        db.setProgress("/bulk/c/2", .5);
+
+        // 1 of 2 files directly in bulk has history, c is a folder
+        db.setFolderSummary("/bulk", {2, 0, 0, 0});
+        db.setProgress("/bulk/f", .5);
+        db.setSeen("/bulk/c", false);
+
+        // flushes queued writes outside of timed section
+        QCOMPARE(summary("/bulk").files, ROWS + 12);
+
+        QElapsedTimer timer;
+        timer.start();
+        auto marked = db.apply(FileHistoryDB::BulkOperation::MarkSeen, mrls);
+        marked.waitForFinished();
+        qInfo("MarkSeen over mrls took %lldms", timer.elapsed());
+        QCOMPARE(marked.result(), ROWS);
+
+        auto batch = db.readBatch(mrls);
+        batch.waitForFinished();
+        QCOMPARE(batch.result().size(), ROWS);
+        QCOMPARE(batch.result().value(mrls[0]).seen.value_or(false), true);
+        QCOMPARE(batch.result().value(mrls[0]).progress.value_or(0), .5);
+
+        // whole tree, only entries with history are reached
+        db.setSeen("/elsewhere/x", true);
+        timer.restart();
+        auto reset = db.apply(FileHistoryDB::BulkOperation::ResetProgress, {}, "/bulk");
+        reset.waitForFinished();
+        qInfo("ResetProgress over tree took %lldms", timer.elapsed());
+        QCOMPARE(reset.result(), ROWS + 4);
+        QCOMPARE(summary("/bulk").progress, 0.);
+
+        auto unmarked = db.apply(FileHistoryDB::BulkOperation::MarkUnseen, {}, "/bulk");
+        unmarked.waitForFinished();
+        QCOMPARE(summary("/bulk").seen, 0);
+
+        auto first = db.read(mrls[0]);
+        first.waitForFinished();
+        QCOMPARE(first.result().seen.value_or(true), false);
+        QCOMPARE(first.result().progress.value_or(1), 0.);
+
+        auto other = db.read("/elsewhere/x");
+        other.waitForFinished();
+        QCOMPARE(other.result().seen.value_or(false), true);
+
+        // summaries of tree follow what was marked, and so do ancestors of it
+        timer.restart();
+        auto seen = db.apply(FileHistoryDB::BulkOperation::MarkSeen, {}, "/bulk");
+        seen.waitForFinished();
+        qInfo("MarkSeen over tree took %lldms", timer.elapsed());
+        QCOMPARE(summary("/bulk/a").seen, ROWS / 2);
+        QCOMPARE(summary("/bulk/c").seen, 2);
+        QCOMPARE(summary("/bulk").seen, ROWS + 3);
+        QCOMPARE(summary("/").seen, ROWS + 3);
+    }
+
+    void testMigration()
+    {
+        const auto path = dbPath("legacy.db");
+
+        {
+            // layout keyed by full MRL
+            auto legacy = QSqlDatabase::addDatabase("QSQLITE", "legacy");
+            legacy.setDatabaseName(path);
+            QVERIFY(legacy.open());
+
+            QSqlQuery q(legacy);
+            QVERIFY(q.exec("CREATE TABLE files (MRL TEXT PRIMARY KEY, SEEN BOOL, PROGRESS DECIMAL, PREVIEWED BOOL)"));
+            QVERIFY(q.exec("INSERT INTO files VALUES ('/lib/a/x', 1, 0.25, NULL), ('/lib/y', NULL, NULL, 1)"));
+            QVERIFY(q.exec("CREATE TABLE folders (PATH TEXT PRIMARY KEY, FILES INTEGER, SEEN INTEGER, PREVIEWED INTEGER, PROGRESS DECIMAL"
+                           ", TOTAL_FILES INTEGER, TOTAL_SEEN INTEGER, TOTAL_PREVIEWED INTEGER, TOTAL_PROGRESS DECIMAL)"));
+            QVERIFY(q.exec("INSERT INTO folders VALUES ('/lib', 1, 0, 1, 0, 2, 1, 1, 0.25)"));
+
+            q.finish();
+            legacy.close();
+        }
+        QSqlDatabase::removeDatabase("legacy");
+
+        FileHistoryDB db(path);
+
+        auto x = db.read("/lib/a/x");
+        x.waitForFinished();
+        QCOMPARE(x.result().seen.value_or(false), true);
+        QCOMPARE(x.result().progress.value_or(0), .25);
+
+        auto batch = db.readBatch({"/lib/a/x", "/lib/y"});
+        batch.waitForFinished();
+        QCOMPARE(batch.result().size(), 2);
+        QCOMPARE(batch.result().value("/lib/y").previewed.value_or(false), true);
+
+        auto summary = db.readFolderSummary("/lib");
+        summary.waitForFinished();
+        QCOMPARE(summary.result().files, 2);
+        QCOMPARE(summary.result().progress, .25);
+
+        // new writes land next to migrated ones
+        db.setSeen("/lib/y", true);
+        auto y = db.read("/lib/y");
+        y.waitForFinished();
+        QCOMPARE(y.result().seen.value_or(false), true);
+        QCOMPARE(y.result().previewed.value_or(false), true);
+    }
+};
+
+QTEST_MAIN(TestFileHistoryDB)
+#include "test_filehistorydb.moc"
@@ -9,6 +9,8 @@
 #include <QFile>
 #include <QString>
 
+#include <atomic>
+
 
 QString withoutTrallingBacklash(const QString &path)
 {
@@ -61,6 +63,7 @@ public:
                 if (fd->fileName(i) == name) {
                     QCOMPARE(fd->isDir(i), isDir);
                     QCOMPARE(fd->fileSize(i), f.second);
+                    QCOMPARE(fd->fileModifiedTime(i), QFileInfo(fd->filePath(i)).lastModified());
                     QVERIFY(!v[j]);
 
                     v[j] = true;
@@ -153,10 +156,144 @@ private slots:
         check(fd4.get(), leanfiles);
     }
 
+    void testFileSystemLeanIncremental()
+    {
+        FileSystem s;
+        s.setIncrementalOpen(true);
+
+        auto fd = s.leanOpen(u"./test-dir/"_qs);
+        QVERIFY(fd);
+
+        auto incremental = dynamic_cast<IncrementalDirectory *>(fd.get());
+        QVERIFY(incremental);
+
+        std::atomic<int> progressCount {0};
+        incremental->setProgressCallback([&progressCount]() { ++progressCount; });
+
+        QTRY_VERIFY(incremental->isComplete());
+        QVERIFY(progressCount > 0);
+
+        incremental->setProgressCallback(nullptr);
+        check(fd.get(), testFiles + testfilesLevel2);
+    }
+
+    void testFileSystemWatch()
+    {
+#ifndef Q_OS_LINUX
+        QSKIP("changes are only followed with inotify");
+#endif
+        FileSystem s;
+        s.setWatchChanges(true);
+
+        auto fd = s.open(u"./test-dir/"_qs);
+        auto watched = dynamic_cast<WatchedDirectory *>(fd.get());
+        QVERIFY(watched);
+
+        std::atomic<int> changeCount {0};
+        watched->setChangeCallback([&changeCount]() { ++changeCount; });
+
+        const auto ignore = [](const DirectoryChange &) {};
+        const auto createdSize = [&]() -> qint64
+        {
+            watched->applyChanges(ignore, ignore);
+            for (int i = 0; i < fd->fileCount(); ++i) {
+                if (fd->fileName(i) == "created file")
+                    return fd->fileSize(i);
+            }
+
+            return -1;
+        };
+
+        QFile created(QDir(testDir).absoluteFilePath("created file"));
+        QVERIFY(created.open(QIODevice::WriteOnly));
+        created.write("12345");
+        created.close();
+
+        QTRY_COMPARE(createdSize(), 5);
+        QVERIFY(changeCount > 0);
+
+        QVERIFY(created.remove());
+        QTRY_COMPARE(createdSize(), -1);
+
+        watched->setChangeCallback(nullptr);
+        check(fd.get(), level1);
+    }
+
+    void testFileSystemVersion()
+    {
+        FileSystem s;
+
+        const auto url = QUrl::fromLocalFile(QDir(testDir).absolutePath());
+        const auto version = s.version(url);
+        QVERIFY(!version.isEmpty());
+        QCOMPARE(s.version(url), version);
+
+        auto fd = s.leanOpen(testDir);
+        QVERIFY(s.version(fd->url()).isEmpty());
+
+        // timestamps may be coarse
+        QTest::qSleep(20);
+
+        QFile created(QDir(testDir).absoluteFilePath("versioned file"));
+        QVERIFY(created.open(QIODevice::WriteOnly));
+        created.close();
+
+        QVERIFY(s.version(url) != version);
+        QVERIFY(created.remove());
+    }
+
+    void testFileSystemCancelled()
+    {
+        FileSystem s;
+
+        const auto cancel = CancellationToken::create();
+        cancel.cancel();
+
+        QVERIFY(!s.open(testDir, cancel));
+        QVERIFY(!s.leanOpen(testDir, cancel));
+
+        s.setIncrementalOpen(true);
+        QVERIFY(!s.leanOpen(testDir, cancel));
+    }
+
+    void testFileSystemColumns()
+    {
+        FileSystem s;
+        auto fd = s.open(testDir);
+        QVERIFY(fd->fileCount() > 1);
+
+        DirectoryColumns columns;
+        fd->fill(0, fd->fileCount(), DirectoryColumns::AllFields, columns);
+        QCOMPARE(columns.names.size(), fd->fileCount());
+
+        for (int i = 0; i < fd->fileCount(); ++i)
+        {
+            QCOMPARE(columns.names[i], fd->fileName(i));
+            QCOMPARE(columns.paths[i], fd->filePath(i));
+            QCOMPARE(columns.sizes[i], fd->fileSize(i));
+            QCOMPARE(columns.dirs[i], fd->isDir(i));
+            QCOMPARE(DirectoryColumns::fromMSecs(columns.modifiedTimes[i]), fd->fileModifiedTime(i));
+        }
+
+        // only requested fields of the range are appended
+        DirectoryColumns partial;
+        fd->fill(1, 1, DirectoryColumns::Paths, partial);
+        QCOMPARE(partial.paths, QStringList {fd->filePath(1)});
+        QVERIFY(partial.names.isEmpty());
+        QVERIFY(partial.sizes.isEmpty());
+    }
+
     void testHybridSystem()
     {
         HybridDirSystem s;
         test(s);
+
+        // dispatch depends only on the directory, not on who opened it
+        FileSystem fs;
+        auto fd = fs.open(testDir);
+        QCOMPARE(fd->type(), DirectoryType::FileSystem);
+        QVERIFY(s.iosource(fd.get(), 0));
+        QVERIFY(s.open(fd.get(), 0));
     }
 
 };
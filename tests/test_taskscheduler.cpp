@@ -0,0 +1,164 @@
+#include <QObject>
+#include <QTest>
+#include <QMutex>
+#include <QSemaphore>
+
+#include <atomic>
+
+#include "../core/taskscheduler.hpp"
+
+class TestTaskScheduler : public QObject
+{
+    Q_OBJECT
+
+    // occupies a thread of @scheduler till released
+    void block(TaskScheduler &scheduler, QSemaphore &started, QSemaphore &gate)
+    {
+        scheduler.start(TaskScheduler::Open, [&started, &gate]()
+        {
+            started.release();
+            gate.acquire();
+        });
+    }
+
+private slots:
+    void testLaneOrder()
+    {
+        TaskScheduler scheduler(2);
+
+        QSemaphore started, gate1, gate2;
+        block(scheduler, started, gate1);
+        block(scheduler, started, gate2);
+        QVERIFY(started.tryAcquire(2, 5000));
+
+        QMutex mutex;
+        QList<int> order;
+        const auto record = [&](int lane)
+        {
+            return [&, lane]()
+            {
+                QMutexLocker locker(&mutex);
+                order.push_back(lane);
+            };
+        };
+
+        scheduler.start(TaskScheduler::Indexing, record(TaskScheduler::Indexing));
+        scheduler.start(TaskScheduler::Prefetch, record(TaskScheduler::Prefetch));
+        scheduler.start(TaskScheduler::Preview, record(TaskScheduler::Preview));
+        scheduler.start(TaskScheduler::Open, record(TaskScheduler::Open));
+
+        QCOMPARE(scheduler.metrics(TaskScheduler::Indexing).queued, 1);
+
+        // single free thread runs queued tasks one after another
+        gate1.release();
+        QTRY_COMPARE(order.size(), 4);
+
+        gate2.release();
+        scheduler.waitForDone();
+
+        const QList<int> expected {TaskScheduler::Open, TaskScheduler::Preview
+                                   , TaskScheduler::Prefetch, TaskScheduler::Indexing};
+        QCOMPARE(order, expected);
+
+        const auto metrics = scheduler.metrics(TaskScheduler::Open);
+        QCOMPARE(metrics.queued, 0);
+        QCOMPARE(metrics.running, 0);
+        QCOMPARE(metrics.started, 3);
+        QCOMPARE(scheduler.metrics(TaskScheduler::Indexing).started, 1);
+    }
+
+    void testLaneLimit()
+    {
+        TaskScheduler scheduler(4);
+        scheduler.setLaneLimit(TaskScheduler::Preview, 1);
+
+        std::atomic<int> running {0};
+        std::atomic<int> peak {0};
+        for (int i = 0; i < 8; ++i)
+        {
+            scheduler.start(TaskScheduler::Preview, [&]()
+            {
+                const int now = ++running;
+                peak = std::max(peak.load(), now);
+                QThread::msleep(5);
+                --running;
+            });
+        }
+
+        scheduler.waitForDone();
+        QCOMPARE(peak.load(), 1);
+        QCOMPARE(scheduler.metrics(TaskScheduler::Preview).started, 8);
+    }
+
+    void testOpenReserved()
+    {
+        TaskScheduler scheduler(2);
+
+        QSemaphore started, gate;
+        for (const auto lane : {TaskScheduler::Preview, TaskScheduler::Prefetch, TaskScheduler::Indexing})
+        {
+            scheduler.start(lane, [&started, &gate]()
+            {
+                started.release();
+                gate.acquire();
+            });
+        }
+
+        // lower lanes together take all threads but one
+        QVERIFY(started.tryAcquire(1, 5000));
+        QVERIFY(!started.tryAcquire(1, 100));
+
+        std::atomic<bool> opened {false};
+        scheduler.start(TaskScheduler::Open, [&opened]() { opened = true; });
+        QTRY_VERIFY(opened.load());
+
+        gate.release(3);
+        scheduler.waitForDone();
+    }
+
+    void testAging()
+    {
+        TaskScheduler scheduler(2);
+
+        QSemaphore started, gate1, gate2;
+        block(scheduler, started, gate1);
+        block(scheduler, started, gate2);
+        QVERIFY(started.tryAcquire(2, 5000));
+
+        QMutex mutex;
+        QList<int> order;
+        scheduler.start(TaskScheduler::Indexing, [&]()
+        {
+            QMutexLocker locker(&mutex);
+            order.push_back(TaskScheduler::Indexing);
+        });
+
+        // long enough to be promoted up to the open lane
+        QTest::qSleep(TaskScheduler::AGING_INTERVAL * (TaskScheduler::Indexing + 1));
+
+        scheduler.start(TaskScheduler::Open, [&]()
+        {
+            QMutexLocker locker(&mutex);
+            order.push_back(TaskScheduler::Open);
+        });
+
+        gate1.release();
+        QTRY_COMPARE(order.size(), 2);
+
+        gate2.release();
+        scheduler.waitForDone();
+
+        const QList<int> expected {TaskScheduler::Indexing, TaskScheduler::Open};
+        QCOMPARE(order, expected);
+    }
+
+    void testRun()
+    {
+        TaskScheduler scheduler;
+        auto future = scheduler.run(TaskScheduler::Preview, [](int a, int b) { return a + b; }, 2, 3);
+        QCOMPARE(future.result(), 5);
+    }
+};
+
+QTEST_MAIN(TestTaskScheduler)
+#include "test_taskscheduler.moc"